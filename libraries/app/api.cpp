@@ -31,6 +31,7 @@
 #include <graphene/chain/get_config.hpp>
 #include <graphene/utilities/key_conversion.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/chain/protocol/signature_key_cache.hpp>
 #include <graphene/chain/confidential_object.hpp>
 #include <graphene/chain/market_object.hpp>
 #include <graphene/chain/transaction_object.hpp>
@@ -78,7 +79,7 @@ namespace graphene { namespace app {
     {
        if( api_name == "database_api" )
        {
-          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ) );
+          _database_api = std::make_shared< database_api >( std::ref( *_app.chain_database() ), _app.api_object_snapshot() );
        }
        else if( api_name == "block_api" )
        {
@@ -192,6 +193,9 @@ namespace graphene { namespace app {
     {
        fc::mutable_variant_object result = _app.p2p_node()->network_get_info();
        result["connection_count"] = _app.p2p_node()->get_connection_count();
+       result["signature_cache"] = fc::variant( signature_key_cache::get_statistics() );
+       result["pending_transactions"] = fc::variant( _app.chain_database()->get_pending_transaction_stats() );
+       result["fork_switches"] = fc::variant( _app.chain_database()->get_fork_switch_stats() );
        return result;
     }
 
@@ -27,6 +27,7 @@
 #include <graphene/app/plugin.hpp>
 
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/chain/protocol/signature_key_cache.hpp>
 #include <graphene/chain/protocol/types.hpp>
 
 #include <graphene/egenesis/egenesis.hpp>
@@ -388,6 +389,13 @@ namespace detail {
          if( _options->count("replay-blockchain") )
             _chain_db->wipe( _data_dir / "blockchain", false );
 
+         if( _options->count("object-journal") && _options->at("object-journal").as<bool>() )
+         {
+            uint64_t compact_mb = _options->count("object-journal-compact-size") ?
+                                  _options->at("object-journal-compact-size").as<uint64_t>() : 1024;
+            _chain_db->enable_journal( compact_mb * 1024 * 1024 );
+         }
+
          try
          {
             _chain_db->open( _data_dir / "blockchain", initial_state, GRAPHENE_CURRENT_DB_VERSION );
@@ -398,6 +406,20 @@ namespace detail {
             throw;
          }
 
+         if( _options->count("api-object-snapshot") )
+         {
+            const fc::path snapshot_dir = _options->at("api-object-snapshot").as<boost::filesystem::path>();
+            ilog( "Serving database_api objects from the snapshot in ${path}", ("path", snapshot_dir) );
+            _api_snapshot = std::make_shared<database_api_snapshot>( snapshot_dir );
+         }
+
+         if( _options->count("signature-cache-size") )
+            signature_key_cache::set_capacity( _options->at("signature-cache-size").as<uint32_t>() );
+         if( _options->count("pending-rebuild-batch-size") )
+            _chain_db->set_pending_rebuild_batch_size( _options->at("pending-rebuild-batch-size").as<uint32_t>() );
+         if( _options->count("block-retention") )
+            _chain_db->set_block_retention( _options->at("block-retention").as<uint32_t>() );
+
          if( _options->count("force-validate") )
          {
             ilog( "All transaction signatures will be validated" );
@@ -887,6 +909,7 @@ namespace detail {
       api_access _apiaccess;
 
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      std::shared_ptr<const database_api_snapshot>          _api_snapshot;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
@@ -932,6 +955,19 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
          ("plugins", bpo::value<string>(), "Space-separated list of plugins to activate")
+         ("object-journal", bpo::value<bool>()->default_value(false),
+          "Persist the object database incrementally through an append-only journal instead of rewriting it on shutdown")
+         ("object-journal-compact-size", bpo::value<uint64_t>()->default_value(1024),
+          "Size in MiB of the object journal above which it is compacted into a full object database, on startup or after the block that crossed it")
+         ("api-object-snapshot", bpo::value<boost::filesystem::path>(),
+          "Blockchain directory of a node whose flushed object database is memory mapped read-only to answer database_api object, account and balance queries. "
+          "It is mapped again when that node flushes, and only used while it holds the head block state of this node's database, which answers otherwise")
+         ("signature-cache-size", bpo::value<uint32_t>()->default_value(signature_key_cache::default_capacity),
+          "Number of public keys recovered from transaction signatures that are kept to verify the same transactions again, 0 to disable")
+         ("pending-rebuild-batch-size", bpo::value<uint32_t>()->default_value(1000),
+          "Number of pending transactions applied again right after each block, the others are applied in batches of this size before new transactions")
+         ("block-retention", bpo::value<uint32_t>()->default_value(0),
+          "Number of blocks below the last irreversible block that are kept on disk, older ones are deleted a segment at a time and can no longer be replayed or served to peers. 0 keeps all blocks")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -1033,6 +1069,11 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+std::shared_ptr<const database_api_snapshot> application::api_object_snapshot() const
+{
+   return my->_api_snapshot;
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->_is_block_producer = producing_blocks;
@@ -53,7 +53,7 @@ class database_api_impl;
 class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 {
    public:
-      database_api_impl( graphene::chain::database& db );
+      database_api_impl( graphene::chain::database& db, std::shared_ptr<const database_api_snapshot> snapshot );
       ~database_api_impl();
 
 
@@ -78,6 +78,7 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       fc::variant_object get_config()const;
       chain_id_type get_chain_id()const;
       dynamic_global_property_object get_dynamic_global_properties()const;
+      fc::sha256 get_state_digest()const;
 
       // Keys
       vector<vector<account_id_type>> get_key_references( vector<public_key_type> key )const;
@@ -229,6 +230,19 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       boost::signals2::scoped_connection                                                                                           _pending_trx_connection;
       map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> >      _market_subscriptions;
       graphene::chain::database&                                                                                                            _db;
+      std::shared_ptr<const database_api_snapshot>                                                                                         _snapshot;
+
+      /** the mapping of the snapshot if it holds the current state of _db, null otherwise */
+      std::shared_ptr<const database_api_snapshot::mapping> current_snapshot()const
+      {
+         if( !_snapshot )
+            return nullptr;
+         auto mapping = _snapshot->current();
+         if( !mapping->head_block_id.valid() || *mapping->head_block_id != _db.head_block_id()
+             || _db.get_pending_transaction_stats().pending_count != 0 )
+            return nullptr;
+         return mapping;
+      }
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -237,12 +251,48 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
 //                                                                  //
 //////////////////////////////////////////////////////////////////////
 
-database_api::database_api( graphene::chain::database& db )
-   : my( new database_api_impl( db ) ) {}
+database_api_snapshot::mapping::mapping( const fc::path& data_dir )
+{
+   objects.open( data_dir );
+   balances_by_owner = objects.build_key_table<account_balance_object>( []( const account_balance_object& b ) {
+      return b.owner.instance.value;
+   });
+   auto dgpo = objects.find<dynamic_global_property_object>( dynamic_global_property_id_type() );
+   if( dgpo.valid() )
+      head_block_id = dgpo->head_block_id;
+}
+
+database_api_snapshot::database_api_snapshot( const fc::path& data_dir )
+   :_data_dir( data_dir ), _mapping( std::make_shared<mapping>( data_dir ) ),
+    _next_check( fc::time_point::now() + fc::seconds( refresh_interval_sec ) ) {}
+
+std::shared_ptr<const database_api_snapshot::mapping> database_api_snapshot::current()const
+{
+   std::lock_guard<std::mutex> guard( _mutex );
+   const fc::time_point now = fc::time_point::now();
+   if( now >= _next_check )
+   {
+      _next_check = now + fc::seconds( refresh_interval_sec );
+      if( graphene::db::object_database::read_flush_id( _data_dir ) != _mapping->objects.flush_id() )
+      {
+         try {
+            _mapping = std::make_shared<mapping>( _data_dir );
+         } catch( const fc::exception& e ) {
+            // e.g. the source is in the middle of a flush, try again later
+            wlog( "Unable to map the new object snapshot, serving the previous one: ${e}", ("e", e.to_detail_string()) );
+         }
+      }
+   }
+   return _mapping;
+}
+
+database_api::database_api( graphene::chain::database& db, std::shared_ptr<const database_api_snapshot> snapshot )
+   : my( new database_api_impl( db, snapshot ) ) {}
 
 database_api::~database_api() {}
 
-database_api_impl::database_api_impl( graphene::chain::database& db ):_db(db)
+database_api_impl::database_api_impl( graphene::chain::database& db, std::shared_ptr<const database_api_snapshot> snapshot )
+   :_db(db), _snapshot(snapshot)
 {
    wlog("creating database api ${x}", ("x",int64_t(this)) );
    _new_connection = _db.new_objects.connect([this](const vector<object_id_type>& ids, const flat_set<account_id_type>& impacted_accounts) {
@@ -294,6 +344,18 @@ fc::variants database_api_impl::get_objects(const vector<object_id_type>& ids)co
 
    std::transform(ids.begin(), ids.end(), std::back_inserter(result),
                   [this](object_id_type id) -> fc::variant {
+      if( const auto snapshot = current_snapshot() )
+      {
+         const char* data;
+         size_t size;
+         if( snapshot->objects.find_serialized( id, data, size ) )
+         {
+            const auto& idx = _db.get_index( id.space(), id.type() );
+            FC_ASSERT( snapshot->objects.get_index( id.space(), id.type() )->header().schema == idx.get_object_version(),
+                       "Incompatible Version, the serialization of objects in this snapshot has changed" );
+            return idx.serialized_to_variant( data, size );
+         }
+      }
       if(auto obj = _db.find_object(id))
          return obj->to_variant();
       return {};
@@ -480,6 +542,16 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
    return _db.get(dynamic_global_property_id_type());
 }
 
+fc::sha256 database_api::get_state_digest()const
+{
+   return my->get_state_digest();
+}
+
+fc::sha256 database_api_impl::get_state_digest()const
+{
+   return _db.state_digest();
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Keys                                                             //
@@ -595,6 +667,15 @@ vector<optional<account_object>> database_api_impl::get_accounts(const vector<ac
    vector<optional<account_object>> result; result.reserve(account_ids.size());
    std::transform(account_ids.begin(), account_ids.end(), std::back_inserter(result),
                   [this](account_id_type id) -> optional<account_object> {
+      if( const auto snapshot = current_snapshot() )
+      {
+         auto o = snapshot->objects.find<account_object>( id );
+         if( o.valid() )
+         {
+            subscribe_to_item( id );
+            return o;
+         }
+      }
       if(auto o = _db.find(id))
       {
          subscribe_to_item( id );
@@ -822,6 +903,37 @@ vector<asset> database_api::get_account_balances(account_id_type id, const flat_
 vector<asset> database_api_impl::get_account_balances(account_id_type acnt, const flat_set<asset_id_type>& assets)const
 {
    vector<asset> result;
+   static const graphene::db::object_snapshot::key_table no_balances;
+   const auto snapshot = current_snapshot();
+   const auto& by_owner = snapshot ? snapshot->balances_by_owner : no_balances;
+   auto itr = std::lower_bound( by_owner.begin(), by_owner.end(), std::make_pair( uint64_t(acnt.instance.value), uint64_t(0) ) );
+   // accounts without balances in the snapshot, e.g. ones created after it, are looked up in the chain database
+   if( itr != by_owner.end() && itr->first == acnt.instance.value )
+   {
+      const auto* idx = snapshot->objects.get_index( account_balance_object::space_id, account_balance_object::type_id );
+      flat_map<asset_id_type, asset> balances;
+      for( ; itr != by_owner.end() && itr->first == acnt.instance.value; ++itr )
+      {
+         auto balance = graphene::db::object_snapshot::get<account_balance_object>( *idx, itr->second );
+         balances[balance.asset_type] = balance.get_balance();
+      }
+      if( assets.empty() )
+      {
+         for( const auto& b : balances )
+            result.push_back( b.second );
+      }
+      else
+      {
+         result.reserve( assets.size() );
+         for( asset_id_type id : assets )
+         {
+            auto b = balances.find( id );
+            result.push_back( b != balances.end() ? b->second : asset( 0, id ) );
+         }
+      }
+      return result;
+   }
+
    if (assets.empty())
    {
       // if the caller passes in an empty list of assets, return balances for all assets the account owns
@@ -1009,29 +1121,24 @@ vector<limit_order_object> database_api::get_limit_orders(asset_id_type a, asset
  */
 vector<limit_order_object> database_api_impl::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
 {
-   const auto& limit_order_idx = _db.get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
+   const auto& books = _db.get_limit_order_books();
 
    vector<limit_order_object> result;
 
-   uint32_t count = 0;
-   auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
-   auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
-   while(limit_itr != limit_end && count < limit)
-   {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
-   count = 0;
-   limit_itr = limit_price_idx.lower_bound(price::max(b,a));
-   limit_end = limit_price_idx.upper_bound(price::min(b,a));
-   while(limit_itr != limit_end && count < limit)
+   auto copy_side = [&]( asset_id_type sell_asset, asset_id_type receive_asset )
    {
-      result.push_back(*limit_itr);
-      ++limit_itr;
-      ++count;
-   }
+      const auto* side = books.find_side( sell_asset, receive_asset );
+      if( side == nullptr ) return;
+      uint32_t count = 0;
+      for( const auto& level : *side )
+         for( const limit_order_object* o : level.second )
+         {
+            if( count++ >= limit ) return;
+            result.push_back( *o );
+         }
+   };
+   copy_side( a, b );
+   copy_side( b, a );
 
    return result;
 }
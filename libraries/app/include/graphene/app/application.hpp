@@ -34,6 +34,7 @@ namespace graphene { namespace app {
    using std::string;
 
    class abstract_plugin;
+   struct database_api_snapshot;
 
    class application
    {
@@ -80,6 +81,8 @@ namespace graphene { namespace app {
 
          net::node_ptr                    p2p_node();
          std::shared_ptr<chain::database> chain_database()const;
+         /// Snapshot given by the api-object-snapshot option, null when database_api uses chain_database()
+         std::shared_ptr<const database_api_snapshot> api_object_snapshot()const;
 
          void set_block_production(bool producing_blocks);
          fc::optional< api_access_info > get_api_access_info( const string& username )const;
@@ -43,6 +43,8 @@
 
 #include <graphene/market_history/market_history_plugin.hpp>
 
+#include <graphene/db/object_snapshot.hpp>
+
 #include <fc/api.hpp>
 #include <fc/optional.hpp>
 #include <fc/variant_object.hpp>
@@ -54,6 +56,7 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace graphene { namespace app {
@@ -112,6 +115,47 @@ struct market_trade
    account_id_type            side2_account_id = GRAPHENE_NULL_ACCOUNT;
 };
 
+/**
+ * @brief read-only object snapshot that database_api answers object, account and balance lookups from
+ *
+ * Loaded by the application when the api-object-snapshot option is set.  The objects stay in the
+ * mapped index files, only the owner lookup table for balances is held in memory.
+ *
+ * The snapshot holds the state of the last full flush of the source node.  It is mapped again when
+ * the source has flushed since, which is checked at most once per refresh_interval_sec.  Lookups are
+ * only answered from it while it holds exactly the state of the chain database of this node, i.e. its
+ * head block is the head block of the chain database and no transactions are pending; otherwise, and
+ * for objects which are not in the snapshot, the chain database answers.  This suits nodes whose chain
+ * database does not advance, like archive or offline nodes serving a flushed state.
+ */
+class database_api_snapshot
+{
+   public:
+      static const uint32_t refresh_interval_sec = 1;
+
+      explicit database_api_snapshot( const fc::path& data_dir );
+
+      struct mapping
+      {
+         explicit mapping( const fc::path& data_dir );
+
+         graphene::db::object_snapshot              objects;
+         /** positions of the account_balance_objects, keyed by the instance of their owner */
+         graphene::db::object_snapshot::key_table   balances_by_owner;
+         /** head block of the flushed state, unset if the snapshot has no dynamic global properties */
+         optional<block_id_type>                    head_block_id;
+      };
+
+      /** the mapping of the latest flush, callers keep it alive while they read from it */
+      std::shared_ptr<const mapping> current()const;
+
+   private:
+      fc::path                                 _data_dir;
+      mutable std::mutex                       _mutex;
+      mutable std::shared_ptr<const mapping>   _mapping;
+      mutable fc::time_point                   _next_check;
+};
+
 /**
  * @brief The database_api class implements the RPC API for the chain database.
  *
@@ -122,7 +166,7 @@ struct market_trade
 class database_api
 {
    public:
-      database_api(graphene::chain::database& db);
+      database_api(graphene::chain::database& db, std::shared_ptr<const database_api_snapshot> snapshot = nullptr);
       ~database_api();
 
       /////////////
@@ -219,6 +263,14 @@ class database_api
        */
       dynamic_global_property_object get_dynamic_global_properties()const;
 
+      /**
+       * @brief Get a digest of the object state at the head block, to compare the state of nodes
+       *
+       * Objects of plugins are included, so nodes only agree if they run the same plugins.  The first
+       * call hashes the complete state, which may take a while.
+       */
+      fc::sha256 get_state_digest()const;
+
       //////////
       // Keys //
       //////////
@@ -656,6 +708,7 @@ FC_API(graphene::app::database_api,
    (get_config)
    (get_chain_id)
    (get_dynamic_global_properties)
+   (get_state_digest)
 
    // Keys
    (get_key_references)
@@ -141,15 +141,16 @@ object_id_type asset_create_evaluator::do_apply( const asset_create_operation& o
       });
    }
 
+   auto next_asset_id = db().get_index_type<asset_index>().get_next_id();
+
    asset_bitasset_data_id_type bit_asset_id;
    if( op.bitasset_opts.valid() )
       bit_asset_id = db().create<asset_bitasset_data_object>( [&]( asset_bitasset_data_object& a ) {
+            a.asset_id = next_asset_id;
             a.options = *op.bitasset_opts;
             a.is_prediction_market = op.is_prediction_market;
          }).id;
 
-   auto next_asset_id = db().get_index_type<asset_index>().get_next_id();
-
    const asset_object& new_asset =
      db().create<asset_object>( [&]( asset_object& a ) {
          a.issuer = op.issuer;
@@ -319,6 +320,17 @@ void_result asset_update_evaluator::do_apply(const asset_update_operation& o)
          d.cancel_order(*itr);
    }
 
+   // the core exchange rate of a market issued asset follows its feed, see database::update_expired_feeds()
+   if( asset_to_update->is_market_issued()
+       && asset_to_update->options.core_exchange_rate != o.new_options.core_exchange_rate )
+   {
+      const asset_bitasset_data_object& bitasset = asset_to_update->bitasset_data(d);
+      if( !bitasset.core_exchange_rate_changed )
+         d.modify( bitasset, []( asset_bitasset_data_object& b ) {
+            b.core_exchange_rate_changed = true;
+         });
+   }
+
    d.modify(*asset_to_update, [&](asset_object& a) {
       if( o.new_issuer )
          a.issuer = *o.new_issuer;
@@ -376,6 +388,8 @@ void_result asset_update_bitasset_evaluator::do_apply(const asset_update_bitasse
       if( should_update_feeds )
          b.update_median_feeds(db().head_block_time());
    });
+   if( should_update_feeds )
+      db().recount_calls_below_maintenance( o.asset_to_update(db()) );
 
    return void_result();
 } FC_CAPTURE_AND_RETHROW( (o) ) }
@@ -420,6 +434,7 @@ void_result asset_update_feed_producers_evaluator::do_apply(const asset_update_f
             a.feeds[*itr];
       a.update_median_feeds(db().head_block_time());
    });
+   db().recount_calls_below_maintenance( o.asset_to_update(db()) );
    db().check_call_orders( o.asset_to_update(db()) );
 
    return void_result();
@@ -569,6 +584,7 @@ void_result asset_publish_feeds_evaluator::do_apply(const asset_publish_feed_ope
       a.feeds[o.publisher] = make_pair(d.head_block_time(), o.feed);
       a.update_median_feeds(d.head_block_time());
    });
+   d.recount_calls_below_maintenance( base );
 
    if( !(old_feed == bad.current_feed) )
    {
@@ -45,6 +45,7 @@ share_type asset_bitasset_data_object::max_force_settlement_volume(share_type cu
 
 void graphene::chain::asset_bitasset_data_object::update_median_feeds(time_point_sec current_time)
 {
+   const price old_core_exchange_rate = current_feed.core_exchange_rate;
    current_feed_publication_time = current_time;
    vector<std::reference_wrapper<const price_feed>> current_feeds;
    for( const pair<account_id_type, pair<time_point_sec,price_feed>>& f : feeds )
@@ -63,29 +64,37 @@ void graphene::chain::asset_bitasset_data_object::update_median_feeds(time_point
       //... don't calculate a median, and set a null feed
       current_feed_publication_time = current_time;
       current_feed = price_feed();
-      return;
    }
-   if( current_feeds.size() == 1 )
+   else if( current_feeds.size() == 1 )
    {
       current_feed = std::move(current_feeds.front());
-      return;
    }
-
-   // *** Begin Median Calculations ***
-   price_feed median_feed;
-   const auto median_itr = current_feeds.begin() + current_feeds.size() / 2;
+   else
+   {
+      // *** Begin Median Calculations ***
+      price_feed median_feed;
+      const auto median_itr = current_feeds.begin() + current_feeds.size() / 2;
 #define CALCULATE_MEDIAN_VALUE(r, data, field_name) \
-   std::nth_element( current_feeds.begin(), median_itr, current_feeds.end(), \
-                     [](const price_feed& a, const price_feed& b) { \
-      return a.field_name < b.field_name; \
-   }); \
-   median_feed.field_name = median_itr->get().field_name;
+      std::nth_element( current_feeds.begin(), median_itr, current_feeds.end(), \
+                        [](const price_feed& a, const price_feed& b) { \
+         return a.field_name < b.field_name; \
+      }); \
+      median_feed.field_name = median_itr->get().field_name;
 
-   BOOST_PP_SEQ_FOR_EACH( CALCULATE_MEDIAN_VALUE, ~, GRAPHENE_PRICE_FEED_FIELDS )
+      BOOST_PP_SEQ_FOR_EACH( CALCULATE_MEDIAN_VALUE, ~, GRAPHENE_PRICE_FEED_FIELDS )
 #undef CALCULATE_MEDIAN_VALUE
-   // *** End Median Calculations ***
+      // *** End Median Calculations ***
+
+      current_feed = median_feed;
+   }
+
+   if( current_feed.settlement_price.is_null() )
+      current_max_short_squeeze_price = price();
+   else
+      current_max_short_squeeze_price = current_feed.max_short_squeeze_price();
 
-   current_feed = median_feed;
+   if( current_feed.core_exchange_rate != old_core_exchange_rate )
+      core_exchange_rate_changed = true;
 }
 
 
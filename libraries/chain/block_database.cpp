@@ -23,56 +23,481 @@
  */
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <boost/filesystem.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
 namespace graphene { namespace chain {
 
 struct index_entry
 {
    uint64_t      block_pos = 0;
+   /** size of the block as stored, 0 if it has been removed */
    uint32_t      block_size = 0;
+   /** size of the serialized block, the same as block_size if it is not compressed */
+   uint32_t      raw_size = 0;
    block_id_type block_id;
+   uint32_t      reserved = 0;
+};
+
+/** the entries of the block database before it was split into segments */
+struct unsegmented_index_entry
+{
+   uint64_t      block_pos = 0;
+   uint32_t      block_size = 0;
+   block_id_type block_id;
+};
+
+struct segment_header
+{
+   static const uint32_t current_format = 2;
+
+   uint32_t format = current_format;
+   uint32_t first_block = 0;
+   uint32_t capacity = 0;
+   uint32_t dictionary_size = 0;
 };
  }}
-FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
+FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(raw_size)(block_id)(reserved) );
 
 namespace graphene { namespace chain {
 
+namespace {
+   const std::string segment_prefix = "segment-";
+   const std::string index_suffix = ".index";
+   /** name of the directory the unsegmented files are converted in */
+   const std::string converting_dir = "converting";
+   /** deflate only looks back this far, a longer dictionary would not help */
+   const uint32_t    max_dictionary_size = 32 * 1024;
+
+   /** @return the compressed block, or an empty vector if compressing does not make it smaller */
+   vector<char> deflate_block( const vector<char>& raw, const vector<char>& dictionary )
+   {
+      z_stream zs;
+      memset( &zs, 0, sizeof(zs) );
+      FC_ASSERT( deflateInit( &zs, Z_DEFAULT_COMPRESSION ) == Z_OK );
+      if( !dictionary.empty() )
+         deflateSetDictionary( &zs, (const Bytef*)dictionary.data(), dictionary.size() );
+      vector<char> result( deflateBound( &zs, raw.size() ) );
+      zs.next_in   = (Bytef*)raw.data();
+      zs.avail_in  = raw.size();
+      zs.next_out  = (Bytef*)result.data();
+      zs.avail_out = result.size();
+      const int rc = deflate( &zs, Z_FINISH );
+      result.resize( zs.total_out );
+      deflateEnd( &zs );
+      if( rc != Z_STREAM_END || result.size() >= raw.size() )
+         result.clear();
+      return result;
+   }
+
+   void inflate_block( const char* data, uint32_t size, char* out, uint32_t raw_size, const vector<char>& dictionary )
+   {
+      z_stream zs;
+      memset( &zs, 0, sizeof(zs) );
+      FC_ASSERT( inflateInit( &zs ) == Z_OK );
+      zs.next_in   = (Bytef*)data;
+      zs.avail_in  = size;
+      zs.next_out  = (Bytef*)out;
+      zs.avail_out = raw_size;
+      int rc = inflate( &zs, Z_FINISH );
+      if( rc == Z_NEED_DICT && !dictionary.empty() )
+      {
+         rc = inflateSetDictionary( &zs, (const Bytef*)dictionary.data(), dictionary.size() );
+         if( rc == Z_OK )
+            rc = inflate( &zs, Z_FINISH );
+      }
+      const uLong inflated = zs.total_out;
+      inflateEnd( &zs );
+      FC_ASSERT( rc == Z_STREAM_END && inflated == raw_size, "Corrupt block in block database" );
+   }
+
+   std::string segment_filename( uint32_t segment_num )
+   {
+      char name[32];
+      snprintf( name, sizeof(name), "%s%08u", segment_prefix.c_str(), segment_num );
+      return name;
+   }
+
+   bool is_segment_file( const std::string& name )
+   {
+      return name.compare( 0, segment_prefix.size(), segment_prefix ) == 0;
+   }
+
+   bool is_index_file( const std::string& name )
+   {
+      return name.size() > index_suffix.size()
+             && name.compare( name.size() - index_suffix.size(), index_suffix.size(), index_suffix ) == 0;
+   }
+}
+
+/**
+ * A segment is a block file and an index file.  Each is written through a stream by the thread storing blocks
+ * and read through a mapping.
+ */
+struct block_database::segment
+{
+   struct mapping
+   {
+      mapping( const fc::path& path, uint64_t size )
+      :file( path.generic_string().c_str(), fc::read_only ),
+       region( file, fc::read_only, 0, size ){}
+
+      const char* data()const { return (const char*)region.get_address(); }
+      uint64_t    size()const { return region.get_size(); }
+
+      fc::file_mapping  file;
+      fc::mapped_region region;
+   };
+
+   struct mapped_file
+   {
+      mapped_file( const fc::path& p ):path(p){}
+
+      /** @return a mapping which covers the bytes [0, end), null if the file is shorter */
+      std::shared_ptr<const mapping> map( uint64_t end )
+      {
+         std::shared_ptr<const mapping> result = std::atomic_load( &current );
+         if( result && result->size() >= end )
+            return result;
+
+         const uint64_t file_size = size;
+         if( file_size < end || file_size == 0 )
+            return nullptr;
+
+         std::lock_guard<std::mutex> lock( remap_mutex );
+         result = std::atomic_load( &current );
+         if( !result || result->size() < end )
+         {
+            // readers still holding the old mapping keep it alive until they are done
+            result = std::make_shared<mapping>( path, file_size );
+            std::atomic_store( &current, result );
+         }
+         return result;
+      }
+
+      /** opens the stream, which is only done once the file is written to */
+      std::fstream& writer()
+      {
+         if( !stream.is_open() )
+         {
+            stream.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+            stream.open( path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+         }
+         return stream;
+      }
+
+      /** writes data at pos and makes it visible to the mappings */
+      void write( uint64_t pos, const char* data, size_t data_size )
+      {
+         std::fstream& out = writer();
+         out.seekp( pos );
+         out.write( data, data_size );
+         // the mappings read the file, not the stream buffer
+         out.flush();
+         if( size < pos + data_size )
+            size = pos + data_size;
+      }
+
+      fc::path                        path;
+      std::fstream                    stream;
+      /** size of the file, including everything written through the stream */
+      std::atomic<uint64_t>           size{0};
+      /** maps a prefix of the file, accessed with std::atomic_load/atomic_store only */
+      std::shared_ptr<const mapping>  current;
+      std::mutex                      remap_mutex;
+   };
+
+   segment( const fc::path& p ):blocks(p),index(p.generic_string() + index_suffix){}
+
+   /** entries are only written up to the highest block stored, so the index file grows with the segment */
+   uint64_t entry_pos( uint32_t block_num )const
+   {
+      return sizeof(index_entry) * uint64_t(block_num - header.first_block);
+   }
+   uint32_t end_block()const { return header.first_block + header.capacity; }
+   /** the highest block which may have an entry, or first_block - 1 if there is none */
+   uint32_t last_entry_block()const
+   {
+      return header.first_block + uint32_t( index.size / sizeof(index_entry) ) - 1;
+   }
+
+   segment_header                  header;
+   vector<char>                    dictionary;
+   /** the header, the dictionary and then the blocks in the order they were stored */
+   mapped_file                     blocks;
+   /** an entry for every block number of the segment up to the highest one stored */
+   mapped_file                     index;
+};
+
+block_database::block_database( uint32_t segment_capacity )
+:_segment_capacity( segment_capacity )
+{
+   FC_ASSERT( segment_capacity > 0 );
+}
+
+block_database::~block_database() {}
+
 void block_database::open( const fc::path& dbdir )
 { try {
+   close();
    fc::create_directories(dbdir);
-   _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-   _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+   if( fc::exists( dbdir / "index" ) )
+      convert_unsegmented_files( dbdir );
+   _dir = dbdir;
 
-   _index_filename = dbdir / "index";
-   if( !fc::exists( _index_filename ) )
+   vector< std::shared_ptr<segment> > found;
+   for( boost::filesystem::directory_iterator itr( dbdir.generic_string() ), end; itr != end; ++itr )
    {
-     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+      const std::string name = itr->path().filename().string();
+      if( !is_segment_file( name ) || is_index_file( name ) )
+         continue;
+      auto seg = std::make_shared<segment>( dbdir / name );
+      seg->blocks.size = fc::file_size( seg->blocks.path );
+      FC_ASSERT( seg->blocks.size >= sizeof(seg->header), "Segment file is truncated", ("file",seg->blocks.path) );
+      std::ifstream in( seg->blocks.path.generic_string().c_str(), std::ifstream::binary );
+      in.read( (char*)&seg->header, sizeof(seg->header) );
+      FC_ASSERT( in && seg->header.format == segment_header::current_format && seg->header.capacity > 0
+                 && seg->header.dictionary_size <= max_dictionary_size, "Invalid segment file", ("file",seg->blocks.path) );
+      seg->dictionary.resize( seg->header.dictionary_size );
+      in.read( seg->dictionary.data(), seg->dictionary.size() );
+      FC_ASSERT( in, "Invalid segment file", ("file",seg->blocks.path) );
+      FC_ASSERT( fc::exists( seg->index.path ), "Segment index file is missing", ("file",seg->index.path) );
+      seg->index.size = fc::file_size( seg->index.path );
+      found.push_back( seg );
    }
-   else
+
+   auto table = std::make_shared<segment_table>();
+   if( !found.empty() )
+      _segment_capacity = found.front()->header.capacity;
+   for( const auto& seg : found )
    {
-     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      FC_ASSERT( seg->header.capacity == _segment_capacity && seg->header.first_block % _segment_capacity == 0,
+                 "Segment does not match the other segments", ("file",seg->blocks.path) );
+      const uint32_t segment_num = seg->header.first_block / _segment_capacity;
+      if( table->size() <= segment_num )
+         table->resize( segment_num + 1 );
+      (*table)[segment_num] = seg;
+      if( seg->index.size >= sizeof(index_entry) )
+         _last_block_hint = std::max( _last_block_hint, seg->last_entry_block() );
    }
+   std::atomic_store( &_segments, std::shared_ptr<const segment_table>( table ) );
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+  return std::atomic_load( &_segments ) != nullptr;
 }
 
 void block_database::close()
 {
-  _blocks.close();
-  _block_num_to_pos.close();
+  std::atomic_store( &_segments, std::shared_ptr<const segment_table>() );
+  _last_block_hint = 0;
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
-  _block_num_to_pos.flush();
+   auto segments = std::atomic_load( &_segments );
+   if( !segments ) return;
+   for( const auto& seg : *segments )
+   {
+      if( !seg ) continue;
+      if( seg->blocks.stream.is_open() )
+         seg->blocks.stream.flush();
+      if( seg->index.stream.is_open() )
+         seg->index.stream.flush();
+   }
+}
+
+std::shared_ptr<block_database::segment> block_database::find_segment( uint32_t block_num )const
+{
+   auto segments = std::atomic_load( &_segments );
+   if( !segments ) return nullptr;
+   const uint32_t segment_num = block_num / _segment_capacity;
+   if( segment_num >= segments->size() ) return nullptr;
+   return (*segments)[segment_num];
+}
+
+block_database::segment& block_database::get_or_create_segment( uint32_t block_num )
+{
+   auto seg = find_segment( block_num );
+   if( seg ) return *seg;
+   FC_ASSERT( is_open(), "Block database is not open" );
+
+   const uint32_t segment_num = block_num / _segment_capacity;
+   seg = std::make_shared<segment>( _dir / segment_filename( segment_num ) );
+   seg->header.first_block = segment_num * _segment_capacity;
+   seg->header.capacity = _segment_capacity;
+   seg->dictionary = build_dictionary( segment_num );
+   seg->header.dictionary_size = seg->dictionary.size();
+   {
+      // the index file comes first, open() ignores one without a block file
+      std::ofstream index( seg->index.path.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      FC_ASSERT( index, "Unable to create segment index file", ("file",seg->index.path) );
+      std::ofstream out( seg->blocks.path.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      out.write( (const char*)&seg->header, sizeof(seg->header) );
+      out.write( seg->dictionary.data(), seg->dictionary.size() );
+      FC_ASSERT( out, "Unable to create segment file", ("file",seg->blocks.path) );
+   }
+   seg->blocks.size = sizeof(seg->header) + seg->dictionary.size();
+
+   auto table = std::make_shared<segment_table>( *std::atomic_load( &_segments ) );
+   if( table->size() <= segment_num )
+      table->resize( segment_num + 1 );
+   (*table)[segment_num] = seg;
+   std::atomic_store( &_segments, std::shared_ptr<const segment_table>( table ) );
+   return *seg;
+}
+
+vector<char> block_database::build_dictionary( uint32_t segment_num )const
+{
+   // the last blocks before the segment share most of their structure, accounts and assets with its blocks
+   vector<char> result;
+   if( segment_num == 0 ) return result;
+   auto prev = find_segment( (segment_num - 1) * _segment_capacity );
+   if( !prev ) return result;
+
+   vector< vector<char> > blocks;
+   size_t total = 0;
+   for( uint32_t block_num = prev->last_entry_block() + 1; block_num-- > prev->header.first_block && total < max_dictionary_size; )
+   {
+      index_entry e;
+      if( !read_index_entry( *prev, block_num, e ) || e.block_size == 0 )
+         continue;
+      try {
+         optional<signed_block> block = read_block( *prev, e );
+         if( !block.valid() ) continue;
+         blocks.push_back( fc::raw::pack( *block ) );
+         total += blocks.back().size();
+      } catch( const fc::exception& ) {
+      }
+   }
+   // the most useful data goes last, where it is closest to the data being compressed
+   for( auto itr = blocks.rbegin(); itr != blocks.rend(); ++itr )
+      result.insert( result.end(), itr->begin(), itr->end() );
+   if( result.size() > max_dictionary_size )
+      result.erase( result.begin(), result.end() - max_dictionary_size );
+   return result;
+}
+
+void block_database::convert_unsegmented_files( const fc::path& dbdir )
+{ try {
+   const fc::path index_path = dbdir / "index";
+   const fc::path blocks_path = dbdir / "blocks";
+   const fc::path converting_path = dbdir / converting_dir;
+   ilog( "Converting block database in ${d} to segments...", ("d", dbdir) );
+
+   // the segments are built aside and moved in before the unsegmented files are removed, so segments found
+   // next to them are left over from an interrupted conversion, which starts over
+   vector<fc::path> leftovers;
+   for( boost::filesystem::directory_iterator itr( dbdir.generic_string() ), end; itr != end; ++itr )
+      if( is_segment_file( itr->path().filename().string() ) )
+         leftovers.push_back( itr->path() );
+   for( const fc::path& leftover : leftovers )
+      fc::remove( leftover );
+   fc::remove_all( converting_path );
+   fc::create_directories( converting_path );
+   _dir = converting_path;
+   std::atomic_store( &_segments, std::shared_ptr<const segment_table>( std::make_shared<segment_table>() ) );
+
+   const uint64_t index_size = fc::file_size( index_path );
+   const uint64_t blocks_size = fc::exists( blocks_path ) ? fc::file_size( blocks_path ) : 0;
+   if( index_size >= sizeof(unsegmented_index_entry) && blocks_size > 0 )
+   {
+      fc::file_mapping index_file( index_path.generic_string().c_str(), fc::read_only );
+      fc::mapped_region index_region( index_file, fc::read_only, 0, index_size );
+      fc::file_mapping blocks_file( blocks_path.generic_string().c_str(), fc::read_only );
+      fc::mapped_region blocks_region( blocks_file, fc::read_only, 0, blocks_size );
+      const char* index = (const char*)index_region.get_address();
+      const char* blocks = (const char*)blocks_region.get_address();
+
+      uint32_t count = 0;
+      for( uint64_t pos = 0; pos + sizeof(unsegmented_index_entry) <= index_size; pos += sizeof(unsegmented_index_entry) )
+      {
+         unsegmented_index_entry e;
+         memcpy( (char*)&e, index + pos, sizeof(e) );
+         if( e.block_size == 0 || e.block_pos + e.block_size > blocks_size )
+            continue;
+         try {
+            fc::datastream<const char*> ds( blocks + e.block_pos, e.block_size );
+            signed_block block;
+            fc::raw::unpack( ds, block );
+            if( block.id() != e.block_id )
+               continue;
+            store( e.block_id, block );
+            if( ++count % 100000 == 0 )
+               ilog( "Converted ${n} blocks", ("n", count) );
+         } catch( const fc::exception& ) {
+         }
+      }
+   }
+   flush();
+   close();
+
+   vector<fc::path> converted;
+   for( boost::filesystem::directory_iterator itr( converting_path.generic_string() ), end; itr != end; ++itr )
+      converted.push_back( itr->path() );
+   for( const fc::path& file : converted )
+      fc::rename( file, dbdir / file.filename() );
+   fc::remove_all( converting_path );
+   // the conversion is complete once the unsegmented index is gone
+   fc::remove( index_path );
+   if( fc::exists( blocks_path ) )
+      fc::remove( blocks_path );
+   ilog( "Done converting block database." );
+} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+
+bool block_database::read_index_entry( segment& seg, uint32_t block_num, index_entry& e )
+{
+   const uint64_t pos = seg.entry_pos( block_num );
+   std::shared_ptr<const segment::mapping> m = seg.index.map( pos + sizeof(e) );
+   if( !m )
+      return false;
+   // entries are not necessarily aligned within the mapping
+   memcpy( (char*)&e, m->data() + pos, sizeof(e) );
+   return true;
+}
+
+void block_database::write_index_entry( segment& seg, uint32_t block_num, const index_entry& e )
+{
+   // entries skipped by a write beyond the end of the file read as zero, i.e. as removed
+   seg.index.write( seg.entry_pos( block_num ), (const char*)&e, sizeof(e) );
+}
+
+optional<signed_block> block_database::read_block( segment& seg, const index_entry& e )
+{
+   if( e.block_size == 0 )
+      return optional<signed_block>();
+   std::shared_ptr<const segment::mapping> m = seg.blocks.map( e.block_pos + e.block_size );
+   if( !m )
+      return optional<signed_block>();
+
+   signed_block result;
+   if( e.raw_size == e.block_size )
+   {
+      fc::datastream<const char*> ds( m->data() + e.block_pos, e.block_size );
+      fc::raw::unpack( ds, result );
+   }
+   else
+   {
+      vector<char> raw( e.raw_size );
+      inflate_block( m->data() + e.block_pos, e.block_size, raw.data(), raw.size(), seg.dictionary );
+      fc::datastream<const char*> ds( raw.data(), raw.size() );
+      fc::raw::unpack( ds, result );
+   }
+   FC_ASSERT( result.id() == e.block_id );
+   return result;
 }
 
 void block_database::store( const block_id_type& _id, const signed_block& b )
@@ -83,33 +508,36 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
-   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_header::num_from_id(id)) );
+   const uint32_t block_num = block_header::num_from_id(id);
+   segment& seg = get_or_create_segment( block_num );
+
+   const auto raw = fc::raw::pack( b );
+   const auto compressed = deflate_block( raw, seg.dictionary );
+   const vector<char>& data = compressed.empty() ? raw : compressed;
+
    index_entry e;
-   _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
-   e.block_size = vec.size();
+   e.block_pos  = seg.blocks.size;
+   e.block_size = data.size();
+   e.raw_size   = raw.size();
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   // the block must be readable before the entry pointing to it is
+   seg.blocks.write( e.block_pos, data.data(), data.size() );
+   write_index_entry( seg, block_num, e );
+   _last_block_hint = std::max( _last_block_hint, block_num );
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
+   const uint32_t block_num = block_header::num_from_id(id);
+   auto seg = find_segment( block_num );
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !seg || !read_index_entry( *seg, block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    if( e.block_id == id )
    {
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e) * int64_t(block_header::num_from_id(id)) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      write_index_entry( *seg, block_num, e );
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -118,13 +546,11 @@ bool block_database::contains( const block_id_type& id )const
    if( id == block_id_type() )
       return false;
 
+   const uint32_t block_num = block_header::num_from_id(id);
+   auto seg = find_segment( block_num );
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() < int64_t(index_pos + sizeof(e)) )
+   if( !seg || !read_index_entry( *seg, block_num, e ) )
       return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
 
    return e.block_id == id && e.block_size > 0;
 }
@@ -132,15 +558,11 @@ bool block_database::contains( const block_id_type& id )const
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
+   auto seg = find_segment( block_num );
    index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_num);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !seg || !read_index_entry( *seg, block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
    return e.block_id;
 }
@@ -149,24 +571,15 @@ optional<signed_block> block_database::fetch_optional( const block_id_type& id )
 {
    try
    {
+      const uint32_t block_num = block_header::num_from_id(id);
+      auto seg = find_segment( block_num );
       index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      if( !seg || !read_index_entry( *seg, block_num, e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
       if( e.block_id != id ) return optional<signed_block>();
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( *seg, e );
    }
    catch (const fc::exception&)
    {
@@ -181,21 +594,12 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 {
    try
    {
+      auto seg = find_segment( block_num );
       index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_num);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      if( !seg || !read_index_entry( *seg, block_num, e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( *seg, e );
    }
    catch (const fc::exception&)
    {
@@ -209,34 +613,31 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 optional<index_entry> block_database::last_index_entry()const {
    try
    {
-      index_entry e;
-
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      std::streampos pos = _block_num_to_pos.tellg();
-      if( pos < long(sizeof(index_entry)) )
-         return optional<index_entry>();
+      auto segments = std::atomic_load( &_segments );
+      if( !segments ) return optional<index_entry>();
 
-      pos -= pos % sizeof(index_entry);
-
-      _blocks.seekg( 0, _block_num_to_pos.end );
-      const std::streampos blocks_size = _blocks.tellg();
-      while( pos > 0 )
+      // search down from the highest block that may be stored, skipping missing segments
+      for( uint32_t block_num = _last_block_hint; block_num > 0; )
       {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-         if( _block_num_to_pos.gcount() == sizeof(e) && e.block_size > 0
-                && int64_t(e.block_pos + e.block_size) <= blocks_size )
+         auto seg = find_segment( block_num );
+         if( !seg || seg->index.size < sizeof(index_entry) )
+         {
+            const uint32_t segment_start = block_num - block_num % _segment_capacity;
+            if( segment_start == 0 ) break;
+            block_num = segment_start - 1;
+            continue;
+         }
+         block_num = std::min( block_num, seg->last_entry_block() );
+
+         index_entry e;
+         if( read_index_entry( *seg, block_num, e ) && e.block_size > 0 )
+         {
             try
             {
-               vector<char> data( e.block_size );
-               _blocks.seekg( e.block_pos );
-               _blocks.read( data.data(), e.block_size );
-               if( _blocks.gcount() == long(e.block_size) )
+               if( read_block( *seg, e ).valid() )
                {
-                  const signed_block block = fc::raw::unpack<signed_block>(data);
-                  if( block.id() == e.block_id )
-                     return e;
+                  _last_block_hint = block_num;
+                  return e;
                }
             }
             catch (const fc::exception&)
@@ -245,8 +646,13 @@ optional<index_entry> block_database::last_index_entry()const {
             catch (const std::exception&)
             {
             }
-         fc::resize_file( _index_filename, pos );
+            // drop the invalid entry, e.g. a block which was not completely written before a crash
+            e.block_size = 0;
+            write_index_entry( *seg, block_num, e );
+         }
+         --block_num;
       }
+      _last_block_hint = 0;
    }
    catch (const fc::exception&)
    {
@@ -271,4 +677,28 @@ optional<block_id_type> block_database::last_id()const
    return optional<block_id_type>();
 }
 
+uint32_t block_database::prune( uint32_t block_num )
+{ try {
+   FC_ASSERT( is_open(), "Block database is not open" );
+   auto segments = std::atomic_load( &_segments );
+   // called for every block, the table is only copied when there is something to delete
+   if( std::none_of( segments->begin(), segments->end(),
+                     [block_num]( const std::shared_ptr<segment>& seg ){ return seg && seg->end_block() <= block_num; } ) )
+      return 0;
+
+   auto table = std::make_shared<segment_table>( *segments );
+   uint32_t count = 0;
+   for( auto& seg : *table )
+      if( seg && seg->end_block() <= block_num )
+      {
+         // readers still holding a mapping of the files can finish, the data stays until they unmap it
+         fc::remove( seg->blocks.path );
+         fc::remove( seg->index.path );
+         seg.reset();
+         ++count;
+      }
+   std::atomic_store( &_segments, std::shared_ptr<const segment_table>( table ) );
+   return count;
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
 } }
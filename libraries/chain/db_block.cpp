@@ -39,6 +39,9 @@
 
 #include <fc/smart_ref_impl.hpp>
 
+#include <exception>
+#include <mutex>
+
 namespace graphene { namespace chain {
 
 bool database::is_known_block( const block_id_type& id )const
@@ -81,7 +84,9 @@ optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 
 const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
-   auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
+   // transactions of popped blocks and discarded pending transactions stay in the cache until they expire
+   FC_ASSERT( is_known_transaction( trx_id ) );
+   auto& index = _recent_transactions.get<by_trx_id>();
    auto itr = index.find(trx_id);
    FC_ASSERT(itr != index.end());
    return itr->trx;
@@ -134,61 +139,14 @@ bool database::_push_block(const signed_block& new_block)
       /// TODO: if the block is greater than the head block and before the next maitenance interval
       // verify that the block signer is in the current set of active witnesses.
 
-      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
+      item_ptr new_head = _fork_db.push_block(new_block);
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
       if( new_head->data.previous != head_block_id() )
       {
          //If the newly pushed block is the same height as head, we get head back in new_head
          //Only switch forks if new_head is actually higher than head
          if( new_head->data.block_num() > head_block_num() )
-         {
-            wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
-            auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
-
-            // pop blocks until we hit the forked block
-            while( head_block_id() != branches.second.back()->data.previous )
-               pop_block();
-
-            // push all blocks on the new fork
-            for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
-            {
-                ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->data.id()) );
-                optional<fc::exception> except;
-                try {
-                   undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
-                   session.commit();
-                }
-                catch ( const fc::exception& e ) { except = e; }
-                if( except )
-                {
-                   wlog( "exception thrown while switching forks ${e}", ("e",except->to_detail_string() ) );
-                   // remove the rest of branches.first from the fork_db, those blocks are invalid
-                   while( ritr != branches.first.rend() )
-                   {
-                      _fork_db.remove( (*ritr)->data.id() );
-                      ++ritr;
-                   }
-                   _fork_db.set_head( branches.second.front() );
-
-                   // pop all blocks from the bad fork
-                   while( head_block_id() != branches.second.back()->data.previous )
-                      pop_block();
-
-                   // restore all blocks from the good fork
-                   for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
-                   {
-                      auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
-                      session.commit();
-                   }
-                   throw *except;
-                }
-            }
-            return true;
-         }
+            return switch_forks( new_head );
          else return false;
       }
    }
@@ -207,6 +165,156 @@ bool database::_push_block(const signed_block& new_block)
    return false;
 } FC_CAPTURE_AND_RETHROW( (new_block) ) }
 
+bool database::switch_forks( item_ptr new_head )
+{
+   const uint32_t skip = get_node_properties().skip_flags;
+   const fc::time_point start_time = fc::time_point::now();
+   fork_switch_stats& stats = _fork_switch_stats;
+   ++stats.switch_count;
+   stats.last_popped_blocks = 0;
+   stats.last_applied_blocks = 0;
+
+   wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
+   auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
+
+   // reject the new branch before anything is unwound if one of its blocks is invalid on its own
+   optional<fc::exception> except;
+   const size_t invalid_pos = validate_fork_branch( branches.first, except );
+   stats.last_validation_time_us = (fc::time_point::now() - start_time).count();
+   if( except )
+   {
+      wlog( "invalid block ${id} on the fork ${e}",
+            ("id",branches.first[invalid_pos]->id)("e",except->to_detail_string()) );
+      // the invalid block and the blocks built on it
+      for( size_t i = 0; i <= invalid_pos; ++i )
+         _fork_db.remove( branches.first[i]->id );
+      _fork_db.set_head( branches.second.front() );
+      ++stats.failed_count;
+      ++stats.rejected_before_unwind_count;
+      stats.last_switch_time_us = (fc::time_point::now() - start_time).count();
+      stats.total_switch_time_us += stats.last_switch_time_us;
+      throw *except;
+   }
+
+   // pop blocks until we hit the forked block
+   while( head_block_id() != branches.second.back()->data.previous )
+   {
+      pop_block();
+      ++stats.last_popped_blocks;
+   }
+
+   // push all blocks on the new fork
+   for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
+   {
+       ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->data.id()) );
+       try {
+          undo_database::session session = _undo_db.start_undo_session();
+          apply_block( (*ritr)->data, skip );
+          _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+          session.commit();
+          ++stats.last_applied_blocks;
+       }
+       catch ( const fc::exception& e ) { except = e; }
+       if( except )
+       {
+          wlog( "exception thrown while switching forks ${e}", ("e",except->to_detail_string() ) );
+          // remove the rest of branches.first from the fork_db, those blocks are invalid
+          while( ritr != branches.first.rend() )
+          {
+             _fork_db.remove( (*ritr)->data.id() );
+             ++ritr;
+          }
+          _fork_db.set_head( branches.second.front() );
+
+          // pop all blocks from the bad fork
+          while( head_block_id() != branches.second.back()->data.previous )
+             pop_block();
+
+          // restore all blocks from the good fork
+          for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
+          {
+             auto session = _undo_db.start_undo_session();
+             apply_block( (*ritr)->data, skip );
+             _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+             session.commit();
+          }
+          ++stats.failed_count;
+          stats.last_switch_time_us = (fc::time_point::now() - start_time).count();
+          stats.total_switch_time_us += stats.last_switch_time_us;
+          throw *except;
+       }
+   }
+
+   stats.last_switch_time_us = (fc::time_point::now() - start_time).count();
+   stats.total_switch_time_us += stats.last_switch_time_us;
+   ilog( "Switched to fork ${id}: popped ${p} blocks and applied ${a} in ${t} ms",
+         ("id",new_head->id)("p",stats.last_popped_blocks)("a",stats.last_applied_blocks)
+         ("t",stats.last_switch_time_us / 1000) );
+   return true;
+}
+
+size_t database::validate_fork_branch( const fork_database::branch_type& branch, optional<fc::exception>& error )
+{
+   const uint32_t skip = get_node_properties().skip_flags;
+   const chain_id_type& chain_id = get_chain_id();
+   const bool check_signatures = !(skip & (skip_transaction_signatures | skip_authority_check));
+
+   // one task for the header of each block and one for each of its transactions
+   vector< std::pair<size_t,int32_t> > tasks;
+   for( size_t b = 0; b < branch.size(); ++b )
+   {
+      tasks.emplace_back( b, -1 );
+      for( size_t t = 0; t < branch[b]->data.transactions.size(); ++t )
+         tasks.emplace_back( b, int32_t(t) );
+   }
+
+   std::mutex errors_mutex;
+   vector< optional<fc::exception> > errors( branch.size() );
+   get_thread_pool().parallel_for( tasks.size(), [&]( size_t i ) {
+      const signed_block& block = branch[tasks[i].first]->data;
+      try {
+         if( tasks[i].second < 0 )
+         {
+            FC_ASSERT( (skip & skip_merkle_check) || block.transaction_merkle_root == block.calculate_merkle_root(),
+                       "Merkle root does not match the transactions of the block" );
+            if( !(skip & skip_witness_signature) )
+               block.signee();
+         }
+         else
+         {
+            const signed_transaction& trx = block.transactions[tasks[i].second];
+            trx.validate();
+            if( check_signatures )
+               trx.get_signature_keys( chain_id );
+         }
+      } catch( const fc::exception& e ) {
+         std::lock_guard<std::mutex> lock( errors_mutex );
+         if( !errors[tasks[i].first] )
+            errors[tasks[i].first] = e;
+      } catch( const std::exception& e ) {
+         std::lock_guard<std::mutex> lock( errors_mutex );
+         if( !errors[tasks[i].first] )
+            errors[tasks[i].first] = fc::std_exception_wrapper::from_current_exception( e );
+      } catch( ... ) {
+         std::lock_guard<std::mutex> lock( errors_mutex );
+         if( !errors[tasks[i].first] )
+            errors[tasks[i].first] = fc::unhandled_exception( FC_LOG_MESSAGE( warn, "unknown error validating a fork block" ),
+                                                              std::current_exception() );
+      }
+   });
+
+   // the branch is newest first, the oldest invalid block decides how much of it is usable
+   for( size_t b = branch.size(); b > 0; --b )
+   {
+      if( errors[b-1] )
+      {
+         error = errors[b-1];
+         return b - 1;
+      }
+   }
+   return branch.size();
+}
+
 /**
  * Attempts to push the transaction into the pending queue
  *
@@ -218,6 +326,8 @@ bool database::_push_block(const signed_block& new_block)
  */
 processed_transaction database::push_transaction( const signed_transaction& trx, uint32_t skip )
 { try {
+   // deferred transactions were received with the node's own skip flags, not with those of this caller
+   apply_deferred_transactions( _pending_rebuild_batch_size );
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
@@ -235,22 +345,101 @@ processed_transaction database::_push_transaction( const signed_transaction& trx
 
    // Create a temporary undo session as a child of _pending_tx_session.
    // The temporary session will be discarded by the destructor if
-   // _apply_transaction fails.  If we make it to merge(), we
-   // apply the changes.
+   // _apply_transaction fails.  If it applies, the session is kept
+   // as the checkpoint of the transaction.
 
    auto temp_session = _undo_db.start_undo_session();
    auto processed_trx = _apply_transaction( trx );
    _pending_tx.push_back(processed_trx);
 
    // notify_changed_objects();
-   // The transaction applied successfully. Merge its changes into the pending block session.
-   temp_session.merge();
+   // The transaction applied successfully. Keep its changes in their own session on top of the pending block session.
+   _pending_tx_checkpoints.push_back( std::move(temp_session) );
+   _pending_tx_skip.push_back( get_node_properties().skip_flags );
 
    // notify anyone listening to pending transactions
    on_pending_transaction( trx );
    return processed_trx;
 }
 
+void database::restore_pending_transactions( vector<processed_transaction>&& pending )
+{
+   const fc::time_point start_time = fc::time_point::now();
+   const fc::time_point_sec now = head_block_time();
+
+   pending_transaction_stats& stats = _pending_stats;
+   stats.last_rebuild_dropped  = 0;
+   stats.last_rebuild_applied  = 0;
+   stats.last_rebuild_failed   = 0;
+   stats.last_rebuild_deferred = 0;
+
+   auto restore = [&]( const signed_transaction& tx ) {
+      // dropping transactions that could not apply any more only takes a lookup
+      if( now > tx.expiration || is_known_transaction( tx.id() ) )
+      {
+         ++stats.last_rebuild_dropped;
+         return;
+      }
+      if( stats.last_rebuild_applied + stats.last_rebuild_failed >= _pending_rebuild_batch_size )
+      {
+         // since push_transaction() takes a signed_transaction,
+         // the operation_results field will be ignored.
+         _deferred_tx.push_back( processed_transaction( tx ) );
+         ++stats.last_rebuild_deferred;
+         return;
+      }
+      try
+      {
+         _push_transaction( tx );
+         ++stats.last_rebuild_applied;
+      }
+      catch( const fc::exception& )
+      {
+         ++stats.last_rebuild_failed;
+      }
+   };
+
+   for( const auto& tx : _popped_tx )
+      restore( tx );
+   _popped_tx.clear();
+   for( const processed_transaction& tx : pending )
+      restore( tx );
+
+   stats.last_rebuild_time_us = (fc::time_point::now() - start_time).count();
+   stats.total_rebuild_time_us += stats.last_rebuild_time_us;
+   ++stats.rebuild_count;
+}
+
+void database::apply_deferred_transactions( uint32_t max_count )
+{
+   const fc::time_point_sec now = head_block_time();
+   uint32_t applied_count = 0;
+   while( applied_count < max_count && !_deferred_tx.empty() )
+   {
+      processed_transaction tx = std::move( _deferred_tx.front() );
+      _deferred_tx.pop_front();
+      if( now > tx.expiration || is_known_transaction( tx.id() ) )
+         continue;
+      ++applied_count;
+      try
+      {
+         _push_transaction( tx );
+      }
+      catch( const fc::exception& )
+      {
+         // the transaction became invalid with the last block
+      }
+   }
+}
+
+pending_transaction_stats database::get_pending_transaction_stats()const
+{
+   pending_transaction_stats result = _pending_stats;
+   result.pending_count  = _pending_tx.size();
+   result.deferred_count = _deferred_tx.size();
+   return result;
+}
+
 processed_transaction database::validate_transaction( const signed_transaction& trx )
 {
    auto session = _undo_db.start_undo_session();
@@ -334,23 +523,51 @@ signed_block database::_generate_block(
    signed_block pending_block;
 
    //
-   // The following code throws away existing pending_tx_session and
-   // rebuilds it by re-applying pending transactions.
+   // Pending transactions were applied on top of the head block, with
+   // the head block time, which is exactly what applying them here
+   // would do as well.  Their state is kept for the longest prefix of
+   // _pending_tx that was applied with at least the checks required
+   // now and fits into the block; only the transactions after it are
+   // undone and re-applied, and postponed if they make the block too
+   // big.
    //
-   // This rebuild is necessary because pending transactions' validity
-   // and semantics may have changed since they were received, because
-   // time-based semantics are evaluated based on the current block
-   // time.  These changes can only be reflected in the database when
-   // the value of the "when" variable is known, which means we need to
-   // re-apply pending transactions in this method.
-   //
-   _pending_tx_session.reset();
-   _pending_tx_session = _undo_db.start_undo_session();
+   if( !_pending_tx_session.valid() )
+      _pending_tx_session = _undo_db.start_undo_session();
+
+   size_t kept_tx_count = 0;
+   if( _pending_tx_checkpoints.size() == _pending_tx.size() )
+   {
+      for( ; kept_tx_count < _pending_tx.size(); ++kept_tx_count )
+      {
+         if( _pending_tx_skip[kept_tx_count] & ~skip )
+            break;
+         size_t new_total_size = total_block_size + fc::raw::pack_size( _pending_tx[kept_tx_count] );
+         if( new_total_size >= maximum_block_size )
+            break;
+         total_block_size = new_total_size;
+         pending_block.transactions.push_back( _pending_tx[kept_tx_count] );
+      }
+   }
+   undo_pending_checkpoints( kept_tx_count );
 
    uint64_t postponed_tx_count = 0;
-   // pop pending state (reset to head block state)
-   for( const processed_transaction& tx : _pending_tx )
+   // the transactions deferred after the last block follow the pending ones, they stay in _deferred_tx so
+   // that the ones which do not make it into the block are restored by push_block()
+   vector<const processed_transaction*> remaining_tx;
+   remaining_tx.reserve( _pending_tx.size() - kept_tx_count + _deferred_tx.size() );
+   for( auto itr = _pending_tx.begin() + kept_tx_count; itr != _pending_tx.end(); ++itr )
+      remaining_tx.push_back( &*itr );
+   const size_t remaining_pending_count = remaining_tx.size();
+   for( const processed_transaction& tx : _deferred_tx )
+      if( head_block_time() <= tx.expiration )
+         remaining_tx.push_back( &tx );
+
+   for( size_t i = 0; i < remaining_tx.size(); ++i )
    {
+      const processed_transaction& tx = *remaining_tx[i];
+      // a deferred transaction may have been pushed again since, and be pending or in this block already
+      if( i >= remaining_pending_count && is_known_transaction( tx.id() ) )
+         continue;
       size_t new_total_size = total_block_size + fc::raw::pack_size( tx );
 
       // postpone transaction if it would make block too big
@@ -384,6 +601,7 @@ signed_block database::_generate_block(
       wlog( "Postponed ${n} transactions due to block size limit", ("n", postponed_tx_count) );
    }
 
+   undo_pending_checkpoints( 0 );
    _pending_tx_session.reset();
 
    // We have temporarily broken the invariant that
@@ -417,6 +635,7 @@ signed_block database::_generate_block(
  */
 void database::pop_block()
 { try {
+   undo_pending_checkpoints( 0 );
    _pending_tx_session.reset();
    auto head_id = head_block_id();
    optional<signed_block> head_block = fetch_block_by_id( head_id );
@@ -432,10 +651,23 @@ void database::pop_block()
 void database::clear_pending()
 { try {
    assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
+   undo_pending_checkpoints( 0 );
    _pending_tx.clear();
+   _deferred_tx.clear();
    _pending_tx_session.reset();
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::undo_pending_checkpoints( size_t keep )
+{
+   // the sessions must be undone newest first, each undoes the top of the undo stack
+   while( _pending_tx_checkpoints.size() > keep )
+   {
+      _pending_tx_checkpoints.back().undo();
+      _pending_tx_checkpoints.pop_back();
+   }
+   _pending_tx_skip.resize( _pending_tx_checkpoints.size() );
+}
+
 uint32_t database::push_applied_operation( const operation& op )
 {
    _applied_ops.emplace_back(op);
@@ -484,6 +716,29 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    return;
 }
 
+void database::recover_signature_keys( const signed_block& next_block )
+{
+   if( next_block.transactions.size() < 2 )
+      return;
+   const chain_id_type& chain_id = get_chain_id();
+   std::mutex error_mutex;
+   std::exception_ptr error;
+   get_thread_pool().parallel_for( next_block.transactions.size(), [&]( size_t i ) {
+      try {
+         next_block.transactions[i].get_signature_keys( chain_id );
+      } catch( const fc::exception& ) {
+         // reported by apply_transaction, in block order
+      } catch( ... ) {
+         // not a validation error, the remaining items still run and the first such error reaches the caller
+         std::lock_guard<std::mutex> lock( error_mutex );
+         if( !error )
+            error = std::current_exception();
+      }
+   });
+   if( error )
+      std::rethrow_exception( error );
+}
+
 void database::_apply_block( const signed_block& next_block )
 { try {
    uint32_t next_block_num = next_block.block_num();
@@ -500,6 +755,9 @@ void database::_apply_block( const signed_block& next_block )
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
 
+   if( !(skip & (skip_transaction_signatures | skip_authority_check)) )
+      recover_signature_keys( next_block );
+
    for( const auto& trx : next_block.transactions )
    {
       /* We do not need to push the undo state for each transaction
@@ -565,9 +823,13 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
-   FC_ASSERT( (skip & skip_transaction_dupe_check) ||
-              trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
+   // the ID is only needed for the dupe check, hashing every transaction is a large part of replaying
+   transaction_id_type trx_id;
+   if( !(skip & skip_transaction_dupe_check) )
+   {
+      trx_id = trx.id();
+      FC_ASSERT( trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
+   }
    transaction_evaluation_state eval_state(this);
    const chain_parameters& chain_parameters = get_global_properties().parameters;
    eval_state._trx = &trx;
@@ -603,7 +865,7 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    {
       create<transaction_object>([&](transaction_object& transaction) {
          transaction.trx_id = trx_id;
-         transaction.trx = trx;
+         transaction.expiration = trx.expiration;
       });
    }
 
@@ -624,6 +886,24 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    auto range = index.equal_range( boost::make_tuple( GRAPHENE_TEMP_ACCOUNT ) );
    std::for_each(range.first, range.second, [](const account_balance_object& b) { FC_ASSERT(b.balance == 0); });
 
+   // only transactions which were applied are cached; the cache is not rolled back with the undo state,
+   // so get_recent_transaction() checks the transaction_index as well
+   if( !(skip & skip_transaction_dupe_check) )
+   {
+      auto& recent_by_id = _recent_transactions.get<by_trx_id>();
+      auto recent_itr = recent_by_id.find( trx_id );
+      if( recent_itr == recent_by_id.end() )
+      {
+         _recent_transactions.insert( recent_transaction{ trx_id, trx } );
+         auto& recent_by_expiration = _recent_transactions.get<by_expiration>();
+         if( _recent_transactions.size() > max_recent_transactions )
+            recent_by_expiration.erase( recent_by_expiration.begin() );
+      }
+      else
+         // the signatures are not part of the ID, keep the ones that were applied last
+         recent_by_id.replace( recent_itr, recent_transaction{ trx_id, trx } );
+   }
+
    return ptrx;
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
@@ -27,6 +27,7 @@
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/chain_property_object.hpp>
 #include <graphene/chain/global_property_object.hpp>
+#include <graphene/chain/market_object.hpp>
 
 #include <fc/smart_ref_impl.hpp>
 
@@ -57,6 +58,11 @@ const fee_schedule&  database::current_fee_schedule()const
    return get_global_properties().parameters.current_fees;
 }
 
+const limit_order_book_index& database::get_limit_order_books()const
+{
+   return *_limit_order_books;
+}
+
 time_point_sec database::head_block_time()const
 {
    return get( dynamic_global_property_id_type() ).time;
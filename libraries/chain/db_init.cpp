@@ -189,7 +189,8 @@ void database::initialize_indexes()
 
    add_index< primary_index<committee_member_index> >();
    add_index< primary_index<witness_index> >();
-   add_index< primary_index<limit_order_index > >();
+   auto limit_order_idx = add_index< primary_index<limit_order_index > >();
+   _limit_order_books = limit_order_idx->add_secondary_index<limit_order_book_index>();
    add_index< primary_index<call_order_index > >();
 
    auto prop_index = add_index< primary_index<proposal_index > >();
@@ -503,6 +504,7 @@ void database::init_genesis(const genesis_state_type& genesis_state)
          }
 
          bitasset_data_id = create<asset_bitasset_data_object>([&](asset_bitasset_data_object& b) {
+            b.asset_id = new_asset_id;
             b.options.short_backing_asset = core_asset.id;
             b.options.minimum_feeds = GRAPHENE_DEFAULT_MINIMUM_FEEDS;
          }).id;
@@ -514,7 +516,7 @@ void database::init_genesis(const genesis_state_type& genesis_state)
 
       total_supplies[ new_asset_id ] += asset.accumulated_fees;
 
-      create<asset_object>([&](asset_object& a) {
+      const asset_object& new_asset = create<asset_object>([&](asset_object& a) {
          a.symbol = asset.symbol;
          a.options.description = asset.description;
          a.precision = asset.precision;
@@ -527,6 +529,9 @@ void database::init_genesis(const genesis_state_type& genesis_state)
          a.dynamic_asset_data_id = dynamic_data_id;
          a.bitasset_data_id = bitasset_data_id;
       });
+      // there is no feed yet, so none of the call orders is below the maintenance ratio
+      if( asset.is_bitasset )
+         update_call_order_view( new_asset, 0 );
    }
 
    // Create initial balances
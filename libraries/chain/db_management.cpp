@@ -29,12 +29,139 @@
 
 #include <fc/io/fstream.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 namespace graphene { namespace chain {
 
+namespace {
+   /**
+    * Reads and decodes the blocks of a replay ahead of the main thread, and checks their transaction
+    * merkle roots, so that the main thread only has to apply them.  A thread of its own hands batches
+    * of blocks to the database thread pool and queues the results, up to a limited number of batches.
+    * It stops after the first batch with a missing block.
+    */
+   class replay_prefetcher
+   {
+      public:
+         struct prefetched_block
+         {
+            optional<signed_block> block;
+            /** set if the transaction merkle root of block has been checked */
+            bool                   merkle_root_valid = false;
+         };
+
+         replay_prefetcher( const block_database& blocks, graphene::db::thread_pool& pool, uint32_t first, uint32_t last )
+         :_blocks(blocks),_pool(pool),_first(first),_last(last)
+         {
+            _thread = std::thread( [this](){ run(); } );
+         }
+         ~replay_prefetcher() { stop(); }
+
+         /** @return the next block, an empty one if it is missing */
+         prefetched_block next()
+         {
+            if( _current_pos == _current.size() )
+            {
+               std::unique_lock<std::mutex> lock( _mutex );
+               _cv.wait( lock, [this](){ return !_batches.empty() || _done; } );
+               if( _batches.empty() )
+               {
+                  if( _error )
+                     std::rethrow_exception( _error );
+                  return prefetched_block();
+               }
+               _current = std::move( _batches.front() );
+               _batches.pop_front();
+               _current_pos = 0;
+               lock.unlock();
+               _cv.notify_all();
+            }
+            return std::move( _current[_current_pos++] );
+         }
+
+         /** stops reading ahead, must be called before blocks are removed from the block database */
+         void stop()
+         {
+            {
+               std::lock_guard<std::mutex> lock( _mutex );
+               _stopping = true;
+            }
+            _cv.notify_all();
+            if( _thread.joinable() )
+               _thread.join();
+         }
+
+      private:
+         static const uint32_t batch_size  = 256;
+         static const size_t   max_batches = 8;
+
+         void run()
+         {
+            try
+            {
+               for( uint64_t first = _first; first <= _last; first += batch_size )
+               {
+                  const size_t count = std::min<uint64_t>( batch_size, _last - first + 1 );
+                  vector<prefetched_block> batch( count );
+                  _pool.parallel_for( count, [&]( size_t i ) {
+                     prefetched_block& p = batch[i];
+                     p.block = _blocks.fetch_by_number( first + i );
+                     if( p.block.valid() )
+                        p.merkle_root_valid = p.block->calculate_merkle_root() == p.block->transaction_merkle_root;
+                  });
+                  const bool gap = std::any_of( batch.begin(), batch.end(),
+                                                []( const prefetched_block& p ){ return !p.block.valid(); } );
+                  {
+                     std::unique_lock<std::mutex> lock( _mutex );
+                     _cv.wait( lock, [this](){ return _stopping || _batches.size() < max_batches; } );
+                     if( _stopping )
+                        break;
+                     _batches.push_back( std::move( batch ) );
+                  }
+                  _cv.notify_all();
+                  if( gap )
+                     break;
+               }
+            }
+            catch( ... )
+            {
+               std::lock_guard<std::mutex> lock( _mutex );
+               _error = std::current_exception();
+            }
+            {
+               std::lock_guard<std::mutex> lock( _mutex );
+               _done = true;
+            }
+            _cv.notify_all();
+         }
+
+         const block_database&                    _blocks;
+         graphene::db::thread_pool&               _pool;
+         const uint32_t                           _first;
+         const uint32_t                           _last;
+
+         std::mutex                               _mutex;
+         std::condition_variable                  _cv;
+         std::deque< vector<prefetched_block> >   _batches;
+         bool                                     _stopping = false;
+         bool                                     _done = false;
+         std::exception_ptr                       _error;
+         std::thread                              _thread;
+
+         /** the batch being consumed, only used by the main thread */
+         vector<prefetched_block>                 _current;
+         size_t                                   _current_pos = 0;
+   };
+}
+
 database::database()
 {
    initialize_indexes();
@@ -70,6 +197,7 @@ void database::reindex( fc::path data_dir )
    }
    else
       _undo_db.disable();
+   replay_prefetcher prefetcher( _block_id_to_block, get_thread_pool(), head_block_num() + 1, last_block_num );
    for( uint32_t i = head_block_num() + 1; i <= last_block_num; ++i )
    {
       if( i % 10000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
@@ -79,10 +207,12 @@ void database::reindex( fc::path data_dir )
          flush();
          ilog( "Done" );
       }
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
+      replay_prefetcher::prefetched_block prefetched = prefetcher.next();
+      const fc::optional< signed_block >& block = prefetched.block;
       if( !block.valid() )
       {
          wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
+         prefetcher.stop();
          uint32_t dropped_count = 0;
          while( true )
          {
@@ -99,13 +229,16 @@ void database::reindex( fc::path data_dir )
          wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
          break;
       }
+      // the merkle root has already been checked by the prefetcher
+      const uint32_t skip_checked = prefetched.merkle_root_valid ? skip_merkle_check : 0;
       if( i < undo_point )
          apply_block(*block, skip_witness_signature |
                              skip_transaction_signatures |
                              skip_transaction_dupe_check |
                              skip_tapos_check |
                              skip_witness_schedule_check |
-                             skip_authority_check);
+                             skip_authority_check |
+                             skip_checked);
       else
       {
          _undo_db.enable();
@@ -114,7 +247,8 @@ void database::reindex( fc::path data_dir )
                             skip_transaction_dupe_check |
                             skip_tapos_check |
                             skip_witness_schedule_check |
-                            skip_authority_check);
+                            skip_authority_check |
+                            skip_checked);
       }
    }
    _undo_db.enable();
@@ -207,13 +341,14 @@ void database::close(bool rewind)
    // DB state (issue #336).
    clear_pending();
 
-   object_database::flush();
+   object_database::persist();
    object_database::close();
 
    if( _block_id_to_block.is_open() )
       _block_id_to_block.close();
 
    _fork_db.reset();
+   _recent_transactions.clear();
 }
 
 } }
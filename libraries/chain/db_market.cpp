@@ -164,6 +164,8 @@ void database::execute_bid( const collateral_bid_object& bid, share_type debt_co
                                              asset(call.collateral, bid.inv_swan_price.base.asset_id),
                                              current_feed.maintenance_collateral_ratio);
       });
+   const asset_object& mia = bid.inv_swan_price.quote.asset_id(*this);
+   update_call_order_view( mia, is_below_maintenance( call_obj, mia.bitasset_data(*this) ) ? 1 : 0 );
 
    if( bid.inv_swan_price.base.asset_id == asset_id_type() )
       modify(bid.bidder(*this).statistics(*this), [&](account_statistics_object& stats) {
@@ -242,32 +244,25 @@ bool database::apply_order(const limit_order_object& new_order_object, bool allo
    const asset_object& sell_asset = get(new_order_object.amount_for_sale().asset_id);
    const asset_object& receive_asset = get(new_order_object.amount_to_receive().asset_id);
 
-   // Possible optimization: We only need to check calls if both are true:
-   //  - The new order is at the front of the book
-   //  - The new order is below the call limit price
+   // check_call_orders returns at once unless a margin call or black swan is possible, see call_orders_need_check
    bool called_some = check_call_orders(sell_asset, allow_black_swan, true); // the first time when checking, call order is maker
    called_some |= check_call_orders(receive_asset, allow_black_swan, true); // the other side, same as above
    if( called_some && !find_object(order_id) ) // then we were filled by call order
       return true;
 
-   const auto& limit_price_idx = get_index_type<limit_order_index>().indices().get<by_price>();
-
-   // TODO: it should be possible to simply check the NEXT/PREV iterator after new_order_object to
-   // determine whether or not this order has "changed the book" in a way that requires us to
-   // check orders. For now I just lookup the lower bound and check for equality... this is log(n) vs
-   // constant time check. Potential optimization.
-
-   auto max_price = ~new_order_object.sell_price;
-   auto limit_itr = limit_price_idx.lower_bound(max_price.max());
-   auto limit_end = limit_price_idx.upper_bound(max_price);
+   // the orders on the other side of the market, best price first, with the oldest first among equal prices
+   const auto& books = get_limit_order_books();
+   const auto max_price = ~new_order_object.sell_price;
 
    bool finished = false;
-   while( !finished && limit_itr != limit_end )
+   while( !finished )
    {
-      auto old_limit_itr = limit_itr;
-      ++limit_itr;
+      // looked up again after every match, which removes the filled order from the book
+      const limit_order_object* old_order = books.best_order( receive_asset.id, sell_asset.id );
+      if( old_order == nullptr || compare_prices( old_order->sell_price, max_price ) < 0 )
+         break;
       // match returns 2 when only the old order was fully filled. In this case, we keep matching; otherwise, we stop.
-      finished = (match(new_order_object, *old_limit_itr, old_limit_itr->sell_price) != 2);
+      finished = (match(new_order_object, *old_order, old_order->sell_price) != 2);
    }
 
    //Possible optimization: only check calls if the new order completely filled some old order
@@ -432,6 +427,11 @@ bool database::fill_order( const call_order_object& order, const asset& pays, co
    FC_ASSERT( order.get_collateral().asset_id == pays.asset_id );
    FC_ASSERT( order.get_collateral() >= pays );
 
+   const asset_object& mia = receives.asset_id(*this);
+   assert( mia.is_market_issued() );
+   // filling leaves the call price alone
+   const bool below_maintenance = is_below_maintenance( order, mia.bitasset_data(*this) );
+
    optional<asset> collateral_freed;
    modify( order, [&]( call_order_object& o ){
             o.debt       -= receives.amount;
@@ -442,8 +442,6 @@ bool database::fill_order( const call_order_object& order, const asset& pays, co
               o.collateral = 0;
             }
        });
-   const asset_object& mia = receives.asset_id(*this);
-   assert( mia.is_market_issued() );
 
    const asset_dynamic_data_object& mia_ddo = mia.dynamic_asset_data_id(*this);
 
@@ -475,6 +473,7 @@ bool database::fill_order( const call_order_object& order, const asset& pays, co
 
    if( collateral_freed )
       remove( order );
+   update_call_order_view( mia, collateral_freed.valid() && below_maintenance ? -1 : 0 );
 
    return collateral_freed.valid();
 } FC_CAPTURE_AND_RETHROW( (order)(pays)(receives) ) }
@@ -506,6 +505,99 @@ bool database::fill_order( const force_settlement_object& settle, const asset& p
    return filled;
 } FC_CAPTURE_AND_RETHROW( (settle)(pays)(receives) ) }
 
+/**
+ *  Tests the conditions under which check_call_orders() acts, in the same order, from the best bid in the
+ *  order book of mia, the call order view and the max short squeeze price kept with the bitasset.  A black
+ *  swan left pending by a cancelled or expired bid is reported like a possible margin call, so skipping
+ *  check_call_orders() when this returns false never changes the outcome.
+ */
+bool database::call_orders_need_check( const asset_object& mia )const
+{
+   if( !mia.is_market_issued() ) return false;
+
+   const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
+   if( bitasset.has_settlement() ) return false;
+   const price& settle_price = bitasset.current_feed.settlement_price;
+   if( settle_price.is_null() ) return false;
+   if( !bitasset.least_collateralized_call.valid() ) return false; // no call orders
+
+   // the limit order selling the most USD for the least CORE
+   const limit_order_object* best_bid = get_limit_order_books().best_order( mia.id, bitasset.options.short_backing_asset );
+
+   // see check_for_blackswan()
+   price highest = settle_price;
+   if( best_bid != nullptr )
+      highest = std::max( best_bid->sell_price, settle_price );
+   if( ~bitasset.least_collateralization >= highest )
+      return true;
+
+   if( bitasset.is_prediction_market ) return false;
+   if( best_bid == nullptr || best_bid->sell_price < bitasset.current_max_short_squeeze_price )
+      return false;
+   // the least collateralized call is feed protected, and so are all the others
+   if( head_block_time() > HARDFORK_436_TIME && bitasset.calls_below_maintenance == 0 )
+      return false;
+   return !( best_bid->sell_price > ~bitasset.least_collateralized_call_price );
+}
+
+bool database::is_below_maintenance( const call_order_object& call, const asset_bitasset_data_object& bitasset )const
+{
+   const price& settle_price = bitasset.current_feed.settlement_price;
+   return !settle_price.is_null() && !( settle_price > ~call.call_price );
+}
+
+void database::update_call_order_view( const asset_object& mia, int32_t below_delta )
+{
+   const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
+   const auto& call_price_index = get_index_type<call_order_index>().indices().get<by_price>();
+   auto call_itr = call_price_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
+
+   optional<call_order_id_type> least;
+   price least_price;
+   price least_collateralization;
+   if( call_itr != call_price_index.end() && call_itr->debt_type() == mia.id
+       && call_itr->call_price.base.asset_id == bitasset.options.short_backing_asset )
+   {
+      least = call_itr->id;
+      least_price = call_itr->call_price;
+      least_collateralization = call_itr->collateralization();
+   }
+
+   // prices are compared by their amounts, the view holds the exact prices of the call order
+   auto same_price = []( const price& a, const price& b ) { return a.base == b.base && a.quote == b.quote; };
+   if( below_delta == 0
+       && least.valid() == bitasset.least_collateralized_call.valid()
+       && ( !least.valid() || *least == *bitasset.least_collateralized_call )
+       && same_price( least_price, bitasset.least_collateralized_call_price )
+       && same_price( least_collateralization, bitasset.least_collateralization ) )
+      return;
+
+   modify( bitasset, [&]( asset_bitasset_data_object& b ) {
+      b.least_collateralized_call = least;
+      b.least_collateralized_call_price = least_price;
+      b.least_collateralization = least_collateralization;
+      b.calls_below_maintenance += below_delta;
+   });
+}
+
+void database::recount_calls_below_maintenance( const asset_object& mia )
+{
+   const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
+   const auto& call_price_index = get_index_type<call_order_index>().indices().get<by_price>();
+
+   // the calls below the maintenance ratio are the ones with the lowest call prices
+   uint32_t count = 0;
+   auto call_itr = call_price_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
+   auto call_end = call_price_index.upper_bound( price::max( bitasset.options.short_backing_asset, mia.id ) );
+   for( ; call_itr != call_end && is_below_maintenance( *call_itr, bitasset ); ++call_itr )
+      ++count;
+
+   if( count != bitasset.calls_below_maintenance )
+      modify( bitasset, [count]( asset_bitasset_data_object& b ) {
+         b.calls_below_maintenance = count;
+      });
+}
+
 /**
  *  Starting with the least collateralized orders, fill them if their
  *  call price is above the max(lowest bid,call_limit).
@@ -521,7 +613,8 @@ bool database::fill_order( const force_settlement_object& settle, const asset& p
  */
 bool database::check_call_orders(const asset_object& mia, bool enable_black_swan, bool for_new_limit_order )
 { try {
-    if( !mia.is_market_issued() ) return false;
+    // most orders, and most changes to call orders and feeds, leave nothing to call
+    if( !call_orders_need_check( mia ) ) return false;
 
     if( check_for_blackswan( mia, enable_black_swan ) ) 
        return false;
@@ -539,7 +632,7 @@ bool database::check_call_orders(const asset_object& mia, bool enable_black_swan
     // looking for limit orders selling the most USD for the least CORE
     auto max_price = price::max( mia.id, bitasset.options.short_backing_asset );
     // stop when limit orders are selling too little USD for too much CORE
-    auto min_price = bitasset.current_feed.max_short_squeeze_price();
+    const price& min_price = bitasset.current_max_short_squeeze_price;
 
     assert( max_price.base.asset_id == min_price.base.asset_id );
     // NOTE limit_price_index is sorted from greatest to least
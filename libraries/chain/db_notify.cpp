@@ -315,9 +315,7 @@ static void get_relevant_accounts( const object* obj, flat_set<account_id_type>&
               accounts.insert( aobj->owner );
               break;
            } case impl_transaction_object_type:{
-              const auto& aobj = dynamic_cast<const transaction_object*>(obj);
-              assert( aobj != nullptr );
-              transaction_get_impacted_accounts( aobj->trx, accounts );
+              // only the ID is kept, the accounts are notified through the operation history
               break;
            } case impl_blinded_balance_object_type:{
               const auto& aobj = dynamic_cast<const blinded_balance_object*>(obj);
@@ -378,13 +376,21 @@ void database::notify_changed_objects()
       // Changed
       if( !changed_objects.empty() )
       {
-        vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
+        vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size() + head_undo.old_fields.size());
         flat_set<account_id_type> changed_accounts_impacted;
         for( const auto& item : head_undo.old_values )
         {
           changed_ids.push_back(item.first);
           get_relevant_accounts(item.second.get(), changed_accounts_impacted);
         }
+        // only the changed fields are kept for these, the accounts they relate to are taken from the current value
+        for( const auto& item : head_undo.old_fields )
+        {
+          changed_ids.push_back(item.first);
+          auto obj = find_object(item.first);
+          if(obj != nullptr)
+            get_relevant_accounts(obj, changed_accounts_impacted);
+        }
 
         changed_objects(changed_ids, changed_accounts_impacted);
       }
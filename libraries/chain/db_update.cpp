@@ -97,6 +97,9 @@ void database::update_global_dynamic_data( const signed_block& b )
 
    _undo_db.set_max_size( _dgp.head_block_number - _dgp.last_irreversible_block_num + 1 );
    _fork_db.set_max_size( _dgp.head_block_number - _dgp.last_irreversible_block_num + 1 );
+
+   if( _block_retention > 0 && _dgp.last_irreversible_block_num > _block_retention )
+      _block_id_to_block.prune( _dgp.last_irreversible_block_num - _block_retention );
 }
 
 void database::update_signing_witness(const witness_object& signing_witness, const signed_block& new_block)
@@ -162,8 +165,12 @@ void database::clear_expired_transactions()
    //Transactions must have expired by at least two forking windows in order to be removed.
    auto& transaction_idx = static_cast<transaction_index&>(get_mutable_index(implementation_ids, impl_transaction_object_type));
    const auto& dedupe_index = transaction_idx.indices().get<by_expiration>();
-   while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.begin()->trx.expiration) )
+   while( (!dedupe_index.empty()) && (head_block_time() > dedupe_index.begin()->expiration) )
       transaction_idx.remove(*dedupe_index.begin());
+
+   auto& recent_index = _recent_transactions.get<by_expiration>();
+   while( (!recent_index.empty()) && (head_block_time() > recent_index.begin()->get_expiration()) )
+      recent_index.erase(recent_index.begin());
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::clear_expired_proposals()
@@ -206,36 +213,18 @@ bool database::check_for_blackswan( const asset_object& mia, bool enable_black_s
     auto settle_price = bitasset.current_feed.settlement_price;
     if( settle_price.is_null() ) return false; // no feed
 
-    const call_order_index& call_index = get_index_type<call_order_index>();
-    const auto& call_price_index = call_index.indices().get<by_price>();
-
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
-    const auto& limit_price_index = limit_index.indices().get<by_price>();
-
-    // looking for limit orders selling the most USD for the least CORE
-    auto highest_possible_bid = price::max( mia.id, bitasset.options.short_backing_asset );
-    // stop when limit orders are selling too little USD for too much CORE
-    auto lowest_possible_bid  = price::min( mia.id, bitasset.options.short_backing_asset );
-
-    assert( highest_possible_bid.base.asset_id == lowest_possible_bid.base.asset_id );
-    // NOTE limit_price_index is sorted from greatest to least
-    auto limit_itr = limit_price_index.lower_bound( highest_possible_bid );
-    auto limit_end = limit_price_index.upper_bound( lowest_possible_bid );
+    if( !bitasset.least_collateralized_call.valid() ) return false;  // no call orders
 
-    auto call_min = price::min( bitasset.options.short_backing_asset, mia.id );
-    auto call_max = price::max( bitasset.options.short_backing_asset, mia.id );
-    auto call_itr = call_price_index.lower_bound( call_min );
-    auto call_end = call_price_index.upper_bound( call_max );
-
-    if( call_itr == call_end ) return false;  // no call orders
+    // the limit order selling the most USD for the least CORE
+    const limit_order_object* best_bid = get_limit_order_books().best_order( mia.id, bitasset.options.short_backing_asset );
 
     price highest = settle_price;
-    if( limit_itr != limit_end ) {
-       assert( settle_price.base.asset_id == limit_itr->sell_price.base.asset_id );
-       highest = std::max( limit_itr->sell_price, settle_price );
+    if( best_bid != nullptr ) {
+       assert( settle_price.base.asset_id == best_bid->sell_price.base.asset_id );
+       highest = std::max( best_bid->sell_price, settle_price );
     }
 
-    auto least_collateral = call_itr->collateralization();
+    const price least_collateral = bitasset.least_collateralization;
     if( ~least_collateral >= highest  ) 
     {
        elog( "Black Swan detected: \n"
@@ -437,35 +426,68 @@ void database::clear_expired_orders()
 
 void database::update_expired_feeds()
 {
-   auto& asset_idx = get_index_type<asset_index>().indices().get<by_type>();
-   auto itr = asset_idx.lower_bound( true /** market issued */ );
-   while( itr != asset_idx.end() )
+   const time_point_sec now = head_block_time();
+   if( now < HARDFORK_615_TIME )
    {
-      const asset_object& a = *itr;
-      ++itr;
-      assert( a.is_market_issued() );
-
-      const asset_bitasset_data_object& b = a.bitasset_data(*this);
-      bool feed_is_expired;
-      if( head_block_time() < HARDFORK_615_TIME )
-         feed_is_expired = b.feed_is_expired_before_hardfork_615( head_block_time() );
-      else
-         feed_is_expired = b.feed_is_expired( head_block_time() );
-      if( feed_is_expired )
+      // before the hardfork a feed counted as expired while it was still valid, which holds for nearly every
+      // market issued asset, so they are all visited
+      auto& asset_idx = get_index_type<asset_index>().indices().get<by_type>();
+      auto itr = asset_idx.lower_bound( true /** market issued */ );
+      while( itr != asset_idx.end() )
       {
-         modify(b, [this](asset_bitasset_data_object& a) {
-            a.update_median_feeds(head_block_time());
-         });
-         check_call_orders(b.current_feed.settlement_price.base.asset_id(*this));
+         const asset_object& a = *itr;
+         ++itr;
+         assert( a.is_market_issued() );
+
+         const asset_bitasset_data_object& b = a.bitasset_data(*this);
+         if( b.feed_is_expired_before_hardfork_615( now ) )
+            update_expired_feed( a, b );
       }
+   }
+   else
+   {
+      // the bitassets are processed in the order of their assets, as they were when all of them were visited;
+      // updating a feed moves it within by_feed_expiration, so they are collected first
+      const auto& exp_idx = get_index_type<asset_bitasset_data_index>().indices().get<by_feed_expiration>();
+      vector<const asset_bitasset_data_object*> expired;
+      for( auto itr = exp_idx.begin(); itr != exp_idx.end() && itr->feed_is_expired( now ); ++itr )
+         expired.push_back( &*itr );
+      std::sort( expired.begin(), expired.end(),
+                 []( const asset_bitasset_data_object* a, const asset_bitasset_data_object* b ) {
+         return a->asset_id < b->asset_id;
+      });
+      for( const asset_bitasset_data_object* b : expired )
+         update_expired_feed( b->asset_id(*this), *b );
+   }
+
+   // bring the core exchange rates of the assets in line with their feeds where either has changed
+   const auto& cer_idx = get_index_type<asset_bitasset_data_index>().indices().get<by_cer_update>();
+   auto itr = cer_idx.lower_bound( true );
+   while( itr != cer_idx.end() )
+   {
+      const asset_bitasset_data_object& b = *itr;
+      ++itr;
+      const asset_object& a = b.asset_id(*this);
       if( !b.current_feed.core_exchange_rate.is_null() &&
           a.options.core_exchange_rate != b.current_feed.core_exchange_rate )
          modify(a, [&b](asset_object& a) {
             a.options.core_exchange_rate = b.current_feed.core_exchange_rate;
          });
+      modify(b, [](asset_bitasset_data_object& b) {
+         b.core_exchange_rate_changed = false;
+      });
    }
 }
 
+void database::update_expired_feed( const asset_object& a, const asset_bitasset_data_object& b )
+{
+   modify(b, [this](asset_bitasset_data_object& o) {
+      o.update_median_feeds(head_block_time());
+   });
+   recount_calls_below_maintenance( a );
+   check_call_orders(b.current_feed.settlement_price.base.asset_id(*this));
+}
+
 void database::update_maintenance_flag( bool new_maintenance_flag )
 {
    modify( get_dynamic_global_properties(), [&]( dynamic_global_property_object& dpo )
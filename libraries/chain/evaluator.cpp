@@ -97,7 +97,7 @@ database& generic_evaluator::db()const { return trx_state->db(); }
       if( !trx_state->skip_fee ) {
          database& d = db();
          /// TODO: db().pay_fee( account_id, core_fee );
-         d.modify(*fee_paying_account_statistics, [&](account_statistics_object& s)
+         d.modify_in< simple_index<account_statistics_object> >(*fee_paying_account_statistics, [&](account_statistics_object& s)
          {
             s.pay_fee( core_fee_paid, d.get_global_properties().parameters.cashback_vesting_threshold );
          });
@@ -26,27 +26,37 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace chain {
 fork_database::fork_database()
 {
 }
+
+fork_database::~fork_database()
+{
+   reset();
+   reclaim_retired();
+}
+
 void fork_database::reset()
 {
-   _head.reset();
-   _index.clear();
+   _head = nullptr;
+   retire_all();
 }
 
 void fork_database::pop_block()
 {
    FC_ASSERT( _head, "no blocks to pop" );
-   auto prev = _head->prev.lock();
+   auto prev = _head->prev;
    FC_ASSERT( prev, "poping block would leave head block null" );
     _head = prev;
 }
 
 void     fork_database::start_block(signed_block b)
 {
-   auto item = std::make_shared<fork_item>(std::move(b));
+   reclaim_retired();
+   auto item = allocate_item( std::make_shared<const signed_block>(std::move(b)) );
    _index.insert(item);
    _head = item;
 }
@@ -55,19 +65,31 @@ void     fork_database::start_block(signed_block b)
  * Pushes the block into the fork database and caches it if it doesn't link
  *
  */
-shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
+item_ptr  fork_database::push_block(const signed_block& b)
 {
-   auto item = std::make_shared<fork_item>(b);
+   return push_block( std::make_shared<const signed_block>(b) );
+}
+
+item_ptr  fork_database::push_block(std::shared_ptr<const signed_block> b)
+{
+   reclaim_retired();
+   auto item = allocate_item( std::move(b) );
    try {
       _push_block(item);
    }
    catch ( const unlinkable_block_exception& e )
    {
-      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
+      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",item->id)("num",item->num) );
       wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
+      _retired_items.push_back( item );
       throw;
       _unlinked_index.insert( item );
    }
+   catch( ... )
+   {
+      _retired_items.push_back( item );
+      throw;
+   }
    return _head;
 }
 
@@ -88,18 +110,24 @@ void  fork_database::_push_block(const item_ptr& item)
       item->prev = *itr;
    }
 
-   _index.insert(item);
+   if( !_index.insert(item).second )
+   {
+      // the block is known already, the existing item stays
+      _retired_items.push_back( item );
+      return;
+   }
    if( !_head ) _head = item;
    else if( item->num > _head->num )
    {
       _head = item;
       uint32_t min_num = _head->num - std::min( _max_size, _head->num );
 //      ilog( "min block in fork DB ${n}, max_size: ${m}", ("n",min_num)("m",_max_size) );
-      auto& num_idx = _index.get<block_num>();
-      while( num_idx.size() && (*num_idx.begin())->num < min_num )
-         num_idx.erase( num_idx.begin() );
-      
-      _unlinked_index.get<block_num>().erase(_head->num - _max_size);
+      prune( _index, min_num );
+
+      auto& unlinked_num_idx = _unlinked_index.get<block_num>();
+      auto unlinked_itr = unlinked_num_idx.find( _head->num - _max_size );
+      while( unlinked_itr != unlinked_num_idx.end() && (*unlinked_itr)->num == _head->num - _max_size )
+         retire_item( unlinked_num_idx, unlinked_itr++ );
    }
    //_push_next( item );
 }
@@ -130,30 +158,69 @@ void fork_database::set_max_size( uint32_t s )
    _max_size = s;
    if( !_head ) return;
 
-   { /// index
-      auto& by_num_idx = _index.get<block_num>();
-      auto itr = by_num_idx.begin();
-      while( itr != by_num_idx.end() )
-      {
-         if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-            by_num_idx.erase(itr);
-         else
-            break;
-         itr = by_num_idx.begin();
-      }
+   const uint32_t min_num = std::max(int64_t(0),int64_t(_head->num) - _max_size);
+   prune( _index, min_num );
+   prune( _unlinked_index, min_num );
+}
+
+void fork_database::prune( fork_multi_index_type& index, uint32_t min_num )
+{
+   auto& by_num_idx = index.get<block_num>();
+   while( !by_num_idx.empty() && (*by_num_idx.begin())->num < min_num )
+      retire_item( by_num_idx, by_num_idx.begin() );
+}
+
+item_ptr fork_database::allocate_item( std::shared_ptr<const signed_block> b )
+{
+   if( _free_items.empty() )
+   {
+      _chunks.emplace_back( new item_storage[chunk_items] );
+      item_storage* chunk = _chunks.back().get();
+      for( size_t i = chunk_items; i > 0; --i )
+         _free_items.push_back( chunk + i - 1 );
    }
-   { /// unlinked_index
-      auto& by_num_idx = _unlinked_index.get<block_num>();
-      auto itr = by_num_idx.begin();
-      while( itr != by_num_idx.end() )
-      {
-         if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-            by_num_idx.erase(itr);
-         else
-            break;
-         itr = by_num_idx.begin();
-      }
+   item_storage* storage = _free_items.back();
+   item_ptr item = new (storage) fork_item( std::move(b) );
+   _free_items.pop_back();
+   return item;
+}
+
+template<typename Index, typename Iterator>
+void fork_database::retire_item( Index& idx, Iterator itr )
+{
+   item_ptr item = *itr;
+   idx.erase( itr );
+
+   // children keep no dangling link to their parent
+   auto children = _index.get<by_previous>().equal_range( item->id );
+   for( auto child = children.first; child != children.second; ++child )
+      if( (*child)->prev == item )
+         (*child)->prev = nullptr;
+   // a removed head block falls back to its parent
+   if( _head == item )
+      _head = item->prev;
+
+   _retired_items.push_back( item );
+}
+
+void fork_database::retire_all()
+{
+   for( item_ptr item : _index )
+      _retired_items.push_back( item );
+   for( item_ptr item : _unlinked_index )
+      _retired_items.push_back( item );
+   _index.clear();
+   _unlinked_index.clear();
+}
+
+void fork_database::reclaim_retired()
+{
+   for( item_ptr item : _retired_items )
+   {
+      item->~fork_item();
+      _free_items.push_back( reinterpret_cast<item_storage*>( item ) );
    }
+   _retired_items.clear();
 }
 
 bool fork_database::is_known_block(const block_id_type& id)const
@@ -203,32 +270,37 @@ pair<fork_database::branch_type,fork_database::branch_type>
    pair<branch_type,branch_type> result;
    auto first_branch_itr = _index.get<block_id>().find(first);
    FC_ASSERT(first_branch_itr != _index.get<block_id>().end());
-   auto first_branch = *first_branch_itr;
+   item_ptr first_branch = *first_branch_itr;
 
    auto second_branch_itr = _index.get<block_id>().find(second);
    FC_ASSERT(second_branch_itr != _index.get<block_id>().end());
-   auto second_branch = *second_branch_itr;
+   item_ptr second_branch = *second_branch_itr;
 
+   // the heights are known, so both branches can be sized up front
+   if( first_branch->num > second_branch->num )
+      result.first.reserve( first_branch->num - second_branch->num + 1 );
+   else
+      result.second.reserve( second_branch->num - first_branch->num + 1 );
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back(first_branch);
-      first_branch = first_branch->prev.lock();
+      first_branch = first_branch->prev;
       FC_ASSERT(first_branch);
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
-      second_branch = second_branch->prev.lock();
+      second_branch = second_branch->prev;
       FC_ASSERT(second_branch);
    }
    while( first_branch->data.previous != second_branch->data.previous )
    {
       result.first.push_back(first_branch);
       result.second.push_back(second_branch);
-      first_branch = first_branch->prev.lock();
+      first_branch = first_branch->prev;
       FC_ASSERT(first_branch);
-      second_branch = second_branch->prev.lock();
+      second_branch = second_branch->prev;
       FC_ASSERT(second_branch);
    }
    if( first_branch && second_branch )
@@ -239,14 +311,38 @@ pair<fork_database::branch_type,fork_database::branch_type>
    return result;
 } FC_CAPTURE_AND_RETHROW( (first)(second) ) }
 
-void fork_database::set_head(shared_ptr<fork_item> h)
+void fork_database::set_head(item_ptr h)
 {
+   auto& index = _index.get<block_id>();
+   auto itr = index.find( h->id );
+   if( itr != index.end() )
+   {
+      _head = *itr;
+      return;
+   }
+
+   // the item was pruned or removed while the caller held it, e.g. by set_max_size during a fork
+   // switch; it is taken back from the retired items before the next push reclaims it
+   auto retired = std::find( _retired_items.begin(), _retired_items.end(), h );
+   FC_ASSERT( retired != _retired_items.end(), "new head is not in the fork database", ("id",h->id) );
+   _retired_items.erase( retired );
+
+   auto prev = index.find( h->previous_id() );
+   h->prev = prev != index.end() ? *prev : nullptr;
+   auto children = _index.get<by_previous>().equal_range( h->id );
+   for( auto child = children.first; child != children.second; ++child )
+      if( (*child)->prev == nullptr )
+         (*child)->prev = h;
+   _index.insert( h );
    _head = h;
 }
 
 void fork_database::remove(block_id_type id)
 {
-   _index.get<block_id>().erase(id);
+   auto& index = _index.get<block_id>();
+   auto itr = index.find(id);
+   if( itr != index.end() )
+      retire_item( index, itr );
 }
 
 } } // graphene::chain
@@ -365,10 +365,16 @@ namespace graphene { namespace chain {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<account_object, account_multi_index_type> account_index;
+   typedef dense_index<account_object, account_multi_index_type> account_index;
 
 }}
 
+namespace graphene { namespace db {
+   // modified by nearly every operation, a few fields at a time
+   template<> struct undo_field_diffs<graphene::chain::account_statistics_object> { static const bool value = true; };
+   template<> struct undo_field_diffs<graphene::chain::account_balance_object>    { static const bool value = true; };
+} }
+
 FC_REFLECT_DERIVED( graphene::chain::account_object,
                     (graphene::db::object),
                     (membership_expiration_date)(registrar)(referrer)(lifetime_referrer)
@@ -171,6 +171,9 @@ namespace graphene { namespace chain {
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_asset_bitasset_data_type;
 
+         /// The asset this object belongs to
+         asset_id_type asset_id;
+
          /// The tunable options for BitAssets are stored in this field.
          bitasset_options options;
 
@@ -183,10 +186,33 @@ namespace graphene { namespace chain {
          price_feed current_feed;
          /// This is the publication time of the oldest feed which was factored into current_feed.
          time_point_sec current_feed_publication_time;
+         /// current_feed.max_short_squeeze_price(), kept with the feed so margin call checks don't recompute it;
+         /// null while there is no feed
+         price current_max_short_squeeze_price;
 
          /// True if this asset implements a @ref prediction_market
          bool is_prediction_market = false;
 
+         /// Set when the core exchange rate of current_feed or of the asset options may have changed, so the
+         /// asset options are brought in line with the feed at the end of the block
+         bool core_exchange_rate_changed = false;
+
+         /**
+          *  The call orders of this asset, as the database keeps track of them while they are created, changed
+          *  and removed and as the feed changes, so margin call and black swan checks need not search the call
+          *  order index.
+          */
+         ///@{
+         /// The call order which is first in line for margin calls, i.e. has the lowest call price; unset if there
+         /// are no call orders
+         optional<call_order_id_type> least_collateralized_call;
+         /// Call price and collateral / debt of least_collateralized_call
+         price least_collateralized_call_price;
+         price least_collateralization;
+         /// Number of call orders at or below the maintenance collateral ratio of current_feed
+         uint32_t calls_below_maintenance = 0;
+         ///@}
+
          /// This is the volume of this asset which has been force-settled this maintanence interval
          share_type force_settled_volume;
          /// Calculate the maximum force settlement volume per maintenance interval, given the current share supply
@@ -218,12 +244,16 @@ namespace graphene { namespace chain {
    };
 
    struct by_feed_expiration;
+   struct by_cer_update;
    typedef multi_index_container<
       asset_bitasset_data_object,
       indexed_by<
          ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
          ordered_non_unique< tag<by_feed_expiration>,
             const_mem_fun< asset_bitasset_data_object, time_point_sec, &asset_bitasset_data_object::feed_expiration_time >
+         >,
+         ordered_non_unique< tag<by_cer_update>,
+            member< asset_bitasset_data_object, bool, &asset_bitasset_data_object::core_exchange_rate_changed >
          >
       >
    > asset_bitasset_data_object_multi_index_type;
@@ -246,7 +276,7 @@ namespace graphene { namespace chain {
          >
       >
    > asset_object_multi_index_type;
-   typedef generic_index<asset_object, asset_object_multi_index_type> asset_index;
+   typedef dense_index<asset_object, asset_object_multi_index_type> asset_index;
 
 } } // graphene::chain
 
@@ -254,6 +284,7 @@ FC_REFLECT_DERIVED( graphene::chain::asset_dynamic_data_object, (graphene::db::o
                     (current_supply)(confidential_supply)(accumulated_fees)(fee_pool) )
 
 FC_REFLECT_DERIVED( graphene::chain::asset_bitasset_data_object, (graphene::db::object),
+                    (asset_id)
                     (feeds)
                     (current_feed)
                     (current_feed_publication_time)
@@ -262,6 +293,12 @@ FC_REFLECT_DERIVED( graphene::chain::asset_bitasset_data_object, (graphene::db::
                     (is_prediction_market)
                     (settlement_price)
                     (settlement_fund)
+                    (current_max_short_squeeze_price)
+                    (least_collateralized_call)
+                    (least_collateralized_call_price)
+                    (least_collateralization)
+                    (calls_below_maintenance)
+                    (core_exchange_rate_changed)
                   )
 
 FC_REFLECT_DERIVED( graphene::chain::asset_object, (graphene::db::object),
@@ -22,15 +22,43 @@
  * THE SOFTWARE.
  */
 #pragma once
-#include <fstream>
+#include <memory>
 #include <graphene/chain/protocol/block.hpp>
 
 namespace graphene { namespace chain {
    class index_entry;
 
+   /**
+    *  Stores blocks in a log of segment files, each holding the blocks of a fixed range of block
+    *  numbers.
+    *
+    *  A segment file holds the blocks in the order they were stored.  Its index file holds a
+    *  fixed-width entry for every block number in its range up to the highest one stored, so it
+    *  grows with the segment.  Blocks are compressed with deflate, using a dictionary taken from
+    *  the last blocks of the previous segment.  Finding a block takes one entry lookup in its
+    *  segment.
+    *
+    *  Once its blocks are irreversible a segment is never written to again, so it can be moved
+    *  elsewhere (e.g. behind a symbolic link) or deleted with prune().
+    *
+    *  Segments are read through read-only memory mappings which are replaced by larger ones as
+    *  they grow.  Reads do not seek or take locks unless a mapping has to be extended, so any
+    *  number of threads can read while one thread writes.
+    */
    class block_database 
    {
       public:
+         /** blocks per segment of a new block database */
+         static const uint32_t default_segment_capacity = 1 << 20;
+
+         /** @param segment_capacity blocks per segment, only used if dbdir holds no segments yet */
+         explicit block_database( uint32_t segment_capacity = default_segment_capacity );
+         ~block_database();
+
+         /**
+          * opens the segments in dbdir, converting the files of the unsegmented format if found; they are only
+          * removed once the conversion is complete, one that was interrupted starts over
+          */
          void open( const fc::path& dbdir );
          bool is_open()const;
          void flush();
@@ -43,12 +71,40 @@ namespace graphene { namespace chain {
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /** @note clears invalid entries at the end of the log, must not run concurrently with reads */
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         /**
+          * Deletes the segments which only hold blocks below block_num.  Their blocks can not be
+          * fetched anymore, so block_num should not be above the last irreversible block.
+          * @return the number of segments deleted
+          */
+         uint32_t prune( uint32_t block_num );
+
+         uint32_t segment_capacity()const { return _segment_capacity; }
+
       private:
-         optional<index_entry> last_index_entry()const;
-         fc::path _index_filename;
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         struct segment;
+         /** segments by number, null where there is none */
+         typedef vector< std::shared_ptr<segment> > segment_table;
+
+         std::shared_ptr<segment>      find_segment( uint32_t block_num )const;
+         /** returns the segment of block_num, creating it if needed */
+         segment&                      get_or_create_segment( uint32_t block_num );
+         vector<char>                  build_dictionary( uint32_t segment_num )const;
+         void                          convert_unsegmented_files( const fc::path& dbdir );
+
+         static bool                   read_index_entry( segment& seg, uint32_t block_num, index_entry& e );
+         static void                   write_index_entry( segment& seg, uint32_t block_num, const index_entry& e );
+         static optional<signed_block> read_block( segment& seg, const index_entry& e );
+         optional<index_entry>         last_index_entry()const;
+
+         fc::path                             _dir;
+         uint32_t                             _segment_capacity;
+         /** replaced as a whole when segments are added or removed, access with std::atomic_load/atomic_store */
+         std::shared_ptr<const segment_table> _segments;
+         /** no block above this number has been stored, last_index_entry() searches down from it */
+         mutable uint32_t                     _last_block_hint = 0;
    };
 } }
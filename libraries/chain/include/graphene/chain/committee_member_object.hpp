@@ -70,7 +70,7 @@ namespace graphene { namespace chain {
          >
       >
    >;
-   using committee_member_index = generic_index<committee_member_object, committee_member_multi_index_type>;
+   using committee_member_index = dense_index<committee_member_object, committee_member_multi_index_type>;
 } } // graphene::chain
 
 FC_REFLECT_DERIVED( graphene::chain::committee_member_object, (graphene::db::object),
@@ -27,6 +27,7 @@
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/fork_database.hpp>
+#include <graphene/chain/transaction_object.hpp>
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/evaluator.hpp>
@@ -47,9 +48,45 @@ namespace graphene { namespace chain {
    using graphene::db::object;
    class op_evaluator;
    class transaction_evaluation_state;
+   class limit_order_book_index;
 
    struct budget_record;
 
+   /** size of the pending transaction pool and the cost of rebuilding it after the last block */
+   struct pending_transaction_stats
+   {
+      /** transactions applied to the pending state */
+      uint32_t pending_count = 0;
+      /** transactions waiting to be applied again, see database::apply_deferred_transactions() */
+      uint32_t deferred_count = 0;
+
+      /** transactions dropped without being applied because they were included in a block or expired */
+      uint32_t last_rebuild_dropped  = 0;
+      uint32_t last_rebuild_applied  = 0;
+      uint32_t last_rebuild_failed   = 0;
+      uint32_t last_rebuild_deferred = 0;
+      int64_t  last_rebuild_time_us  = 0;
+      uint64_t rebuild_count         = 0;
+      int64_t  total_rebuild_time_us = 0;
+   };
+
+   /** number and cost of the fork switches since the database was opened */
+   struct fork_switch_stats
+   {
+      uint64_t switch_count = 0;
+      /** fork switches given up because a block of the new branch was invalid */
+      uint64_t failed_count = 0;
+      /** failed fork switches which were caught by the staged validation, before any block was popped */
+      uint64_t rejected_before_unwind_count = 0;
+
+      uint32_t last_popped_blocks      = 0;
+      uint32_t last_applied_blocks     = 0;
+      /** time spent validating the new branch before unwinding the current one */
+      int64_t  last_validation_time_us = 0;
+      int64_t  last_switch_time_us     = 0;
+      int64_t  total_switch_time_us    = 0;
+   };
+
    /**
     *   @class database
     *   @brief tracks the blockchain state in an extensible manner
@@ -142,6 +179,27 @@ namespace graphene { namespace chain {
          bool _push_block( const signed_block& b );
          processed_transaction _push_transaction( const signed_transaction& trx );
 
+         /**
+          * Puts the popped transactions and the given pending transactions back into the pending state after a
+          * block was pushed.  Transactions included in a block or expired are dropped first; of the rest only
+          * the pending rebuild batch size is applied right away, the others are deferred.
+          */
+         void restore_pending_transactions( vector<processed_transaction>&& pending );
+         /**
+          * Applies up to max_count deferred transactions to the pending state.  push_transaction() applies a
+          * batch before each new transaction, with the skip flags of the node rather than those it was called
+          * with, and _generate_block() applies all of them that are not known yet.
+          */
+         void apply_deferred_transactions( uint32_t max_count );
+         void set_pending_rebuild_batch_size( uint32_t batch_size ) { _pending_rebuild_batch_size = batch_size; }
+         /**
+          * Stored blocks further than this below the last irreversible block are deleted, a segment at a time
+          * (see block_database::prune()).  0 keeps all blocks.  Blocks that were deleted can not be replayed.
+          */
+         void set_block_retention( uint32_t blocks ) { _block_retention = blocks; }
+         pending_transaction_stats get_pending_transaction_stats()const;
+         const fork_switch_stats&  get_fork_switch_stats()const { return _fork_switch_stats; }
+
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
 
@@ -257,6 +315,8 @@ namespace graphene { namespace chain {
          const dynamic_global_property_object&  get_dynamic_global_properties()const;
          const node_property_object&            get_node_properties()const;
          const fee_schedule&                    current_fee_schedule()const;
+         /** the limit orders of each market, see limit_order_book_index */
+         const limit_order_book_index&          get_limit_order_books()const;
 
          time_point_sec   head_block_time()const;
          uint32_t         head_block_num()const;
@@ -386,6 +446,22 @@ namespace graphene { namespace chain {
                           const price& fill_price, const bool is_maker );
 
          bool check_call_orders( const asset_object& mia, bool enable_black_swan = true, bool for_new_limit_order = false );
+         /**
+          * @return false if check_call_orders( mia ) would neither globally settle mia nor margin call any of its
+          * call orders, decided without walking the order books
+          */
+         bool call_orders_need_check( const asset_object& mia )const;
+
+         /** @return true if call is at or below the maintenance collateral ratio of the current feed of its asset */
+         bool is_below_maintenance( const call_order_object& call, const asset_bitasset_data_object& bitasset )const;
+         /**
+          * Brings the call order view of mia up to date after one of its call orders was created, changed or removed.
+          * @param below_delta change of the number of its call orders below the maintenance collateral ratio
+          * @see asset_bitasset_data_object::least_collateralized_call
+          */
+         void update_call_order_view( const asset_object& mia, int32_t below_delta );
+         /** counts the call orders of mia below the maintenance collateral ratio again, after its feed changed */
+         void recount_calls_below_maintenance( const asset_object& mia );
 
          // helpers to fill_order
          void pay_order( const account_object& receiver, const asset& receives, const asset& pays );
@@ -406,6 +482,9 @@ namespace graphene { namespace chain {
           * can be reapplied at the proper time */
          std::deque< signed_transaction >       _popped_tx;
 
+         /** pending transactions which were not applied again yet after the last block, in pending order */
+         std::deque< processed_transaction >    _deferred_tx;
+
          /**
           * @}
           */
@@ -416,6 +495,16 @@ namespace graphene { namespace chain {
 
       private:
          optional<undo_database::session>       _pending_tx_session;
+         /**
+          * One undo session for each transaction in _pending_tx, stacked on top of _pending_tx_session, and the skip
+          * flags each was applied with.  They let _generate_block keep the state of a prefix of the pending
+          * transactions and undo only the rest.
+          */
+         vector<undo_database::session>         _pending_tx_checkpoints;
+         vector<uint32_t>                       _pending_tx_skip;
+         uint32_t                               _pending_rebuild_batch_size = 1000;
+         pending_transaction_stats              _pending_stats;
+         fork_switch_stats                      _fork_switch_stats;
          vector< unique_ptr<op_evaluator> >     _operation_evaluators;
 
          template<class Index>
@@ -430,6 +519,21 @@ namespace graphene { namespace chain {
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
       private:
          void                  _apply_block( const signed_block& next_block );
+         /**
+          * Recovers the signing keys of all transactions of the block on the worker threads, so that
+          * the authority checks of apply_transaction find them already cached in each transaction.
+          */
+         void                  recover_signature_keys( const signed_block& next_block );
+         /**
+          * Checks everything about the blocks of a fork branch that does not depend on the state, on the worker
+          * threads: merkle roots, block signatures and the transactions' own validation and signatures.
+          * @param branch the new branch as returned by fork_database::fetch_branch_from(), newest block first
+          * @return the position in branch of the oldest invalid block, branch.size() if all are valid
+          */
+         size_t                validate_fork_branch( const fork_database::branch_type& branch, optional<fc::exception>& error );
+         bool                  switch_forks( item_ptr new_head );
+         /** undoes the pending transactions after the first keep ones, the transactions stay in _pending_tx */
+         void                  undo_pending_checkpoints( size_t keep );
          processed_transaction _apply_transaction( const signed_transaction& trx );
          void                  _cancel_bids_and_revive_mpa( const asset_object& bitasset, const asset_bitasset_data_object& bad );
 
@@ -448,6 +552,7 @@ namespace graphene { namespace chain {
          void clear_expired_proposals();
          void clear_expired_orders();
          void update_expired_feeds();
+         void update_expired_feed( const asset_object& a, const asset_bitasset_data_object& b );
          void update_maintenance_flag( bool new_maintenance_flag );
          void update_withdraw_permissions();
          bool check_for_blackswan( const asset_object& mia, bool enable_black_swan = true );
@@ -474,6 +579,13 @@ namespace graphene { namespace chain {
          vector< processed_transaction >        _pending_tx;
          fork_database                          _fork_db;
 
+         /** serves get_recent_transaction(), filled along with the transaction_index */
+         recent_transaction_cache               _recent_transactions;
+         static const uint32_t                  max_recent_transactions = 65536;
+
+         /** secondary index of the limit_order_index, owned by it */
+         const limit_order_book_index*          _limit_order_books = nullptr;
+
          /**
           *  Note: we can probably store blocks by block num rather than
           *  block id because after the undo window is past the block ID
@@ -484,6 +596,8 @@ namespace graphene { namespace chain {
           *  the fork tree relatively simple.
           */
          block_database   _block_id_to_block;
+         /** see set_block_retention() */
+         uint32_t         _block_retention = 0;
 
          /**
           * Contains the set of ops that are in the process of being applied from
@@ -528,3 +642,12 @@ namespace graphene { namespace chain {
    }
 
 } }
+
+FC_REFLECT( graphene::chain::pending_transaction_stats,
+            (pending_count)(deferred_count)
+            (last_rebuild_dropped)(last_rebuild_applied)(last_rebuild_failed)(last_rebuild_deferred)
+            (last_rebuild_time_us)(rebuild_count)(total_rebuild_time_us) )
+FC_REFLECT( graphene::chain::fork_switch_stats,
+            (switch_count)(failed_count)(rejected_before_unwind_count)
+            (last_popped_blocks)(last_applied_blocks)
+            (last_validation_time_us)(last_switch_time_us)(total_switch_time_us) )
@@ -71,41 +71,16 @@ struct pending_transactions_restorer
    pending_transactions_restorer( database& db, std::vector<processed_transaction>&& pending_transactions )
       : _db(db), _pending_transactions( std::move(pending_transactions) )
    {
+      // transactions deferred by the previous rebuild keep their place behind the pending ones
+      for( auto& tx : _db._deferred_tx )
+         _pending_transactions.push_back( std::move(tx) );
+      _db._deferred_tx.clear();
       _db.clear_pending();
    }
 
    ~pending_transactions_restorer()
    {
-      for( const auto& tx : _db._popped_tx )
-      {
-         try {
-            if( !_db.is_known_transaction( tx.id() ) ) {
-               // since push_transaction() takes a signed_transaction,
-               // the operation_results field will be ignored.
-               _db._push_transaction( tx );
-            }
-         } catch ( const fc::exception&  ) {
-         }
-      }
-      _db._popped_tx.clear();
-      for( const processed_transaction& tx : _pending_transactions )
-      {
-         try
-         {
-            if( !_db.is_known_transaction( tx.id() ) ) {
-               // since push_transaction() takes a signed_transaction,
-               // the operation_results field will be ignored.
-               _db._push_transaction( tx );
-            }
-         }
-         catch( const fc::exception& e )
-         {
-            /*
-            wlog( "Pending transaction became invalid after switching to block ${b}  ${t}", ("b", _db.head_block_id())("t",_db.head_block_time()) );
-            wlog( "The invalid pending transaction caused exception ${e}", ("e", e.to_detail_string() ) );
-            */
-         }
-      }
+      _db.restore_pending_transactions( std::move(_pending_transactions) );
    }
 
    database& _db;
@@ -30,24 +30,37 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <memory>
+#include <type_traits>
+
 
 namespace graphene { namespace chain {
    using boost::multi_index_container;
    using namespace boost::multi_index;
 
+   /**
+    * A node of the fork tree.  Nodes are allocated by the fork_database and stay at the same address until they
+    * are pruned or removed; the block itself is shared, so neither nodes nor branches ever copy a block.
+    */
    struct fork_item
    {
-      fork_item( signed_block d )
-      :num(d.block_num()),id(d.id()),data( std::move(d) ){}
+      fork_item( std::shared_ptr<const signed_block> b )
+      :num(b->block_num()),id(b->id()),block( std::move(b) ),data(*block){}
 
       block_id_type previous_id()const { return data.previous; }
 
-      weak_ptr< fork_item > prev;
-      uint32_t              num;    // initialized in ctor
-      block_id_type         id;
-      signed_block          data;
+      /** the parent node, null if it is not in the fork database (any more) */
+      fork_item*                          prev = nullptr;
+      uint32_t                            num;    // initialized in ctor
+      block_id_type                       id;
+      std::shared_ptr<const signed_block> block;
+      const signed_block&                 data;
+
+      private:
+         fork_item( const fork_item& ) = delete;
+         fork_item& operator=( const fork_item& ) = delete;
    };
-   typedef shared_ptr<fork_item> item_ptr;
+   typedef fork_item* item_ptr;
 
 
    /**
@@ -59,6 +72,10 @@ namespace graphene { namespace chain {
     *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
+    *
+    *  The item pointers handed out stay valid until the
+    *  next push_block(), start_block() or reset(), even
+    *  if the item is removed or pruned in the meantime.
     */
    class fork_database
    {
@@ -68,20 +85,23 @@ namespace graphene { namespace chain {
          const static int MAX_BLOCK_REORDERING = 1024;
 
          fork_database();
+         ~fork_database();
          void reset();
 
          void                             start_block(signed_block b);
          void                             remove(block_id_type b);
-         void                             set_head(shared_ptr<fork_item> h);
+         /** an item which was pruned or removed since it was handed out is put back into the database */
+         void                             set_head(item_ptr h);
          bool                             is_known_block(const block_id_type& id)const;
-         shared_ptr<fork_item>            fetch_block(const block_id_type& id)const;
+         item_ptr                         fetch_block(const block_id_type& id)const;
          vector<item_ptr>                 fetch_block_by_number(uint32_t n)const;
 
          /**
           *  @return the new head block ( the longest fork )
           */
-         shared_ptr<fork_item>            push_block(const signed_block& b);
-         shared_ptr<fork_item>            head()const { return _head; }
+         item_ptr                         push_block(const signed_block& b);
+         item_ptr                         push_block(std::shared_ptr<const signed_block> b);
+         item_ptr                         head()const { return _head; }
          void                             pop_block();
 
          /**
@@ -106,14 +126,34 @@ namespace graphene { namespace chain {
          void set_max_size( uint32_t s );
 
       private:
+         fork_database( const fork_database& ) = delete;
+         fork_database& operator=( const fork_database& ) = delete;
+
          /** @return a pointer to the newly pushed item */
          void _push_block(const item_ptr& b );
          void _push_next(const item_ptr& newly_inserted);
 
+         /** takes a node from the arena, reclaiming the nodes retired since the last push first */
+         item_ptr allocate_item( std::shared_ptr<const signed_block> b );
+         /** erases the node from idx and unlinks its children, its memory is reclaimed on the next push */
+         template<typename Index, typename Iterator>
+         void     retire_item( Index& idx, Iterator itr );
+         void     retire_all();
+         void     reclaim_retired();
+         void     prune( fork_multi_index_type& index, uint32_t min_num );
+
+         /** nodes are carved out of chunks of this many items */
+         static const size_t chunk_items = 256;
+         typedef std::aligned_storage< sizeof(fork_item), alignof(fork_item) >::type item_storage;
+
          uint32_t                 _max_size = 1024;
 
          fork_multi_index_type    _unlinked_index;
          fork_multi_index_type    _index;
-         shared_ptr<fork_item>    _head;
+         item_ptr                 _head = nullptr;
+
+         vector< std::unique_ptr<item_storage[]> > _chunks;
+         vector< item_storage* >   _free_items;
+         vector< item_ptr >        _retired_items;
    };
 } } // graphene::chain
@@ -30,6 +30,9 @@
 
 #include <boost/multi_index/composite_key.hpp>
 
+#include <vector>
+#include <map>
+
 namespace graphene { namespace chain {
 
 using namespace graphene::db;
@@ -84,7 +87,7 @@ typedef multi_index_container<
             member< limit_order_object, price, &limit_order_object::sell_price>,
             member< object, object_id_type, &object::id>
          >,
-         composite_key_compare< std::greater<price>, std::less<object_id_type> >
+         composite_key_compare< price_greater, std::less<object_id_type> >
       >,
       ordered_unique< tag<by_account>,
          composite_key< limit_order_object,
@@ -97,6 +100,45 @@ typedef multi_index_container<
 
 typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
 
+/**
+ *  @brief This secondary index keeps a separate order book for every market.
+ *
+ *  Limit orders are grouped by the asset they sell and the asset they receive, then into price
+ *  levels, best price first, with the orders of each level queued by ID, i.e. in the order they
+ *  were placed.  Walking the book of one market this way touches only the orders of that market,
+ *  where the by_price index of the limit_order_index interleaves the orders of all markets.
+ *
+ *  The orders are referenced by address, which the limit_order_index keeps stable for as long
+ *  as an order exists.
+ */
+class limit_order_book_index : public secondary_index
+{
+   public:
+      /** orders at one price, oldest first; most levels hold a few orders, so a vector is the cheapest queue */
+      typedef std::vector<const limit_order_object*>      price_level;
+      /** the orders selling one asset for another, best (highest) price first */
+      typedef std::map<price, price_level, price_greater> book_side;
+
+      virtual void object_inserted( const object& obj ) override;
+      virtual void object_removed( const object& obj ) override;
+      virtual void about_to_modify( const object& before ) override;
+      virtual void object_modified( const object& after  ) override;
+
+      /** @return the orders selling sell_asset for receive_asset, nullptr if there are none */
+      const book_side* find_side( asset_id_type sell_asset, asset_id_type receive_asset )const;
+
+      /** @return the oldest order at the best price selling sell_asset for receive_asset, nullptr if there is none */
+      const limit_order_object* best_order( asset_id_type sell_asset, asset_id_type receive_asset )const;
+
+   private:
+      void add( const limit_order_object& o, const price& p );
+      void remove( const limit_order_object& o, const price& p );
+
+      map< pair<asset_id_type,asset_id_type>, book_side > _books;
+      /** price of the order being modified, see about_to_modify() */
+      price                                               _price_before_modify;
+};
+
 /**
  * @class call_order_object
  * @brief tracks debt and call price information
@@ -183,7 +225,7 @@ typedef multi_index_container<
             member< call_order_object, price, &call_order_object::call_price>,
             member< object, object_id_type, &object::id>
          >,
-         composite_key_compare< std::less<price>, std::less<object_id_type> >
+         composite_key_compare< price_less, std::less<object_id_type> >
       >,
       ordered_unique< tag<by_account>,
          composite_key< call_order_object,
@@ -195,7 +237,8 @@ typedef multi_index_container<
          composite_key< call_order_object,
             const_mem_fun< call_order_object, price, &call_order_object::collateralization >,
             member< object, object_id_type, &object::id >
-         >
+         >,
+         composite_key_compare< price_less, std::less<object_id_type> >
       >
    >
 > call_order_multi_index_type;
@@ -238,7 +281,7 @@ typedef multi_index_container<
             member< collateral_bid_object, price, &collateral_bid_object::inv_swan_price >,
             member< object, object_id_type, &object::id >
          >,
-         composite_key_compare< std::less<asset_id_type>, std::greater<price>, std::less<object_id_type> >
+         composite_key_compare< std::less<asset_id_type>, price_greater, std::less<object_id_type> >
       >
    >
 > collateral_bid_object_multi_index_type;
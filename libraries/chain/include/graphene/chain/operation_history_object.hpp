@@ -24,6 +24,7 @@
 #pragma once
 #include <graphene/chain/protocol/operations.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/simple_index.hpp>
 #include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
@@ -99,16 +100,8 @@ namespace graphene { namespace chain {
          //std::pair<account_id_type,uint32_t>                   account_seq()const { return std::tie( account, sequence );     }
    };
 
-   struct by_id;
-
-   typedef multi_index_container<
-      operation_history_object,
-      indexed_by<
-         ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >
-      >
-   > operation_history_multi_index_type;
-
-   typedef generic_index<operation_history_object, operation_history_multi_index_type> operation_history_index;
+   /** operation history is only ever looked up by ID, which is allocated sequentially */
+   typedef simple_index<operation_history_object> operation_history_index;
 
    struct by_seq;
    struct by_op;
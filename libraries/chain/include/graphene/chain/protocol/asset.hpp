@@ -146,6 +146,41 @@ namespace graphene { namespace chain {
    bool  operator != ( const price& a, const price& b );
    asset operator *  ( const asset& a, const price& b );
 
+   /**
+    * Three-way comparison of two prices, ordering them like operator< does: by base asset, then by
+    * quote asset, then by the cross products of the amounts.  The products are computed with the
+    * compiler's native 128 bit integers where available, so the comparison is a handful of inlined
+    * instructions; the order book indexes call it at every step of every tree descent.
+    *
+    * @return negative if a < b, zero if a == b, positive if a > b
+    */
+   inline int compare_prices( const price& a, const price& b )
+   {
+      const auto a_base = a.base.asset_id.instance.value, b_base = b.base.asset_id.instance.value;
+      if( a_base != b_base ) return a_base < b_base ? -1 : 1;
+      const auto a_quote = a.quote.asset_id.instance.value, b_quote = b.quote.asset_id.instance.value;
+      if( a_quote != b_quote ) return a_quote < b_quote ? -1 : 1;
+#ifdef __SIZEOF_INT128__
+      const unsigned __int128 amult = (unsigned __int128)b.quote.amount.value * (unsigned __int128)a.base.amount.value;
+      const unsigned __int128 bmult = (unsigned __int128)a.quote.amount.value * (unsigned __int128)b.base.amount.value;
+      return amult < bmult ? -1 : ( bmult < amult ? 1 : 0 );
+#else
+      return a < b ? -1 : ( a == b ? 0 : 1 );
+#endif
+   }
+
+   /** orders prices like std::less<price>, for use as the key comparison of the order book indexes */
+   struct price_less
+   {
+      bool operator()( const price& a, const price& b )const { return compare_prices( a, b ) < 0; }
+   };
+
+   /** orders prices like std::greater<price>, for use as the key comparison of the order book indexes */
+   struct price_greater
+   {
+      bool operator()( const price& a, const price& b )const { return compare_prices( a, b ) > 0; }
+   };
+
    /**
     *  @class price_feed
     *  @brief defines market parameters for margin positions
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/types.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    * @brief process wide LRU cache of the public keys recovered from transaction signatures
+    *
+    * A transaction is verified when it is received, again when a witness applies it to a block
+    * it produces and again when that block is pushed, and every one of these recovers the same
+    * keys from the same signatures.  The cache remembers the key for each (digest, signature)
+    * pair so only the first verification pays for the elliptic curve operations.  It is safe to
+    * use from several threads at once.
+    */
+   class signature_key_cache
+   {
+      public:
+         struct statistics
+         {
+            uint64_t hits     = 0;
+            uint64_t misses   = 0;
+            uint32_t size     = 0;
+            uint32_t capacity = 0;
+         };
+
+         static const uint32_t default_capacity = 16384;
+
+         /** @return the key that produced sig over digest, recovered or from the cache */
+         static public_key_type recover( const signature_type& sig, const digest_type& digest );
+
+         /** sets the maximum number of cached keys, evicting the least recently used ones; 0 disables the cache */
+         static void       set_capacity( uint32_t capacity );
+         static statistics get_statistics();
+         /** removes all keys and resets the counters */
+         static void       clear();
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::signature_key_cache::statistics, (hits)(misses)(size)(capacity) )
@@ -123,6 +123,21 @@ namespace graphene { namespace chain {
       signed_transaction( const transaction& trx = transaction() )
          : transaction(trx){}
 
+      /// Copies do not take over the keys recovered by get_signature_keys(), only moves do
+      /// @{
+      signed_transaction( const signed_transaction& trx )
+         : transaction(trx), signatures(trx.signatures){}
+      signed_transaction( signed_transaction&& trx ) = default;
+      signed_transaction& operator=( const signed_transaction& trx )
+      {
+         transaction::operator=( trx );
+         signatures = trx.signatures;
+         _signees_valid = false;
+         return *this;
+      }
+      signed_transaction& operator=( signed_transaction&& trx ) = default;
+      /// @}
+
       /** signs and appends to signatures */
       const signature_type& sign( const private_key_type& key, const chain_id_type& chain_id );
 
@@ -165,12 +180,24 @@ namespace graphene { namespace chain {
          uint32_t max_recursion = GRAPHENE_MAX_SIG_CHECK_DEPTH
          ) const;
 
+      /**
+       * Recovers the keys of all signatures.  The result is remembered along with the digest and
+       * signatures it was recovered from, so that validating the same instance again does not
+       * repeat the elliptic curve operations.  Copies and other instances of the same transaction
+       * find the individual keys in the @ref signature_key_cache.
+       */
       flat_set<public_key_type> get_signature_keys( const chain_id_type& chain_id )const;
 
       vector<signature_type> signatures;
 
       /// Removes all operations and signatures
       void clear() { operations.clear(); signatures.clear(); }
+
+   private:
+      mutable bool                      _signees_valid = false;
+      mutable digest_type               _signees_digest;
+      mutable vector<signature_type>    _signees_signatures;
+      mutable flat_set<public_key_type> _signees;
    };
 
    void verify_authority( const vector<operation>& ops, const flat_set<public_key_type>& sigs,
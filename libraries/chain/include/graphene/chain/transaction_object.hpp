@@ -43,6 +43,9 @@ namespace graphene { namespace chain {
     * The purpose of this object is to enable the detection of duplicate transactions. When a transaction is included
     * in a block a transaction_object is added. At the end of block processing all transaction_objects that have
     * expired can be removed from the index.
+    *
+    * Only the ID and expiration are kept, these objects are created for every transaction and copied into the undo
+    * state.  The transactions themselves are kept in the database's @ref recent_transaction_cache.
     */
    class transaction_object : public abstract_object<transaction_object>
    {
@@ -50,10 +53,8 @@ namespace graphene { namespace chain {
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_transaction_object_type;
 
-         signed_transaction  trx;
          transaction_id_type trx_id;
-
-         time_point_sec get_expiration()const { return trx.expiration; }
+         time_point_sec      expiration;
    };
 
    struct by_expiration;
@@ -64,11 +65,36 @@ namespace graphene { namespace chain {
       indexed_by<
          ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
          hashed_unique< tag<by_trx_id>, BOOST_MULTI_INDEX_MEMBER(transaction_object, transaction_id_type, trx_id), std::hash<transaction_id_type> >,
-         ordered_non_unique< tag<by_expiration>, const_mem_fun<transaction_object, time_point_sec, &transaction_object::get_expiration > >
+         ordered_non_unique< tag<by_expiration>, BOOST_MULTI_INDEX_MEMBER(transaction_object, time_point_sec, expiration) >
       >
    > transaction_multi_index_type;
 
    typedef generic_index<transaction_object, transaction_multi_index_type> transaction_index;
+
+   /**
+    * A transaction included in a recent block, kept outside of the object database so that it can be served to peers
+    * and API clients without being part of the undo state.
+    */
+   struct recent_transaction
+   {
+      transaction_id_type trx_id;
+      signed_transaction  trx;
+
+      time_point_sec get_expiration()const { return trx.expiration; }
+   };
+
+   /**
+    * Bounded cache of the transactions of recent blocks.  Entries are dropped once they expire or, when the cache is
+    * full, starting with the ones that expire first.  It is not rolled back when blocks are popped, so only the
+    * entries that are still in the transaction_index are served.
+    */
+   typedef multi_index_container<
+      recent_transaction,
+      indexed_by<
+         hashed_unique< tag<by_trx_id>, BOOST_MULTI_INDEX_MEMBER(recent_transaction, transaction_id_type, trx_id), std::hash<transaction_id_type> >,
+         ordered_non_unique< tag<by_expiration>, const_mem_fun<recent_transaction, time_point_sec, &recent_transaction::get_expiration > >
+      >
+   > recent_transaction_cache;
 } }
 
-FC_REFLECT_DERIVED( graphene::chain::transaction_object, (graphene::db::object), (trx)(trx_id) )
+FC_REFLECT_DERIVED( graphene::chain::transaction_object, (graphene::db::object), (trx_id)(expiration) )
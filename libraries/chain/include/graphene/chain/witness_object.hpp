@@ -67,7 +67,7 @@ namespace graphene { namespace chain {
          >
       >
    >;
-   using witness_index = generic_index<witness_object, witness_multi_index_type>;
+   using witness_index = dense_index<witness_object, witness_multi_index_type>;
 } } // graphene::chain
 
 FC_REFLECT_DERIVED( graphene::chain::witness_object, (graphene::db::object),
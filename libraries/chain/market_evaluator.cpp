@@ -197,6 +197,7 @@ void_result call_order_update_evaluator::do_apply(const call_order_update_operat
    auto& call_idx = d.get_index_type<call_order_index>().indices().get<by_account>();
    auto itr = call_idx.find( boost::make_tuple(o.funding_account, o.delta_debt.asset_id) );
    const call_order_object* call_obj = nullptr;
+   bool was_below_maintenance = false;
 
    if( itr == call_idx.end() )
    {
@@ -215,6 +216,7 @@ void_result call_order_update_evaluator::do_apply(const call_order_update_operat
    else
    {
       call_obj = &*itr;
+      was_below_maintenance = d.is_below_maintenance( *call_obj, *_bitasset_data );
 
       d.modify( *call_obj, [&]( call_order_object& call ){
           call.collateral += o.delta_collateral.amount;
@@ -232,8 +234,11 @@ void_result call_order_update_evaluator::do_apply(const call_order_update_operat
    {
       FC_ASSERT( call_obj->collateral == 0 );
       d.remove( *call_obj );
+      d.update_call_order_view( *_debt_asset, was_below_maintenance ? -1 : 0 );
       return void_result();
    }
+   d.update_call_order_view( *_debt_asset, int32_t( d.is_below_maintenance( *call_obj, *_bitasset_data ) )
+                                           - int32_t( was_below_maintenance ) );
 
    FC_ASSERT(call_obj->collateral > 0 && call_obj->debt > 0);
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/market_object.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace chain {
+
+namespace {
+   bool order_id_less( const limit_order_object* a, const limit_order_object* b )
+   {
+      return a->id < b->id;
+   }
+}
+
+void limit_order_book_index::add( const limit_order_object& o, const price& p )
+{
+   auto& level = _books[ std::make_pair( p.base.asset_id, p.quote.asset_id ) ][ p ];
+   // new orders have the highest IDs, only orders put back by undo land in the middle of a level
+   if( level.empty() || level.back()->id < o.id )
+      level.push_back( &o );
+   else
+      level.insert( std::lower_bound( level.begin(), level.end(), &o, order_id_less ), &o );
+}
+
+void limit_order_book_index::remove( const limit_order_object& o, const price& p )
+{
+   auto side_itr = _books.find( std::make_pair( p.base.asset_id, p.quote.asset_id ) );
+   if( side_itr == _books.end() ) return;
+   book_side& side = side_itr->second;
+   auto level_itr = side.find( p );
+   if( level_itr == side.end() ) return;
+
+   price_level& level = level_itr->second;
+   auto itr = std::lower_bound( level.begin(), level.end(), &o, order_id_less );
+   if( itr != level.end() && *itr == &o )
+      level.erase( itr );
+
+   if( level.empty() )
+   {
+      side.erase( level_itr );
+      if( side.empty() )
+         _books.erase( side_itr );
+   }
+}
+
+void limit_order_book_index::object_inserted( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) );
+   const limit_order_object& o = static_cast<const limit_order_object&>(obj);
+   add( o, o.sell_price );
+}
+
+void limit_order_book_index::object_removed( const object& obj )
+{
+   assert( dynamic_cast<const limit_order_object*>(&obj) );
+   const limit_order_object& o = static_cast<const limit_order_object&>(obj);
+   remove( o, o.sell_price );
+}
+
+void limit_order_book_index::about_to_modify( const object& before )
+{
+   assert( dynamic_cast<const limit_order_object*>(&before) );
+   _price_before_modify = static_cast<const limit_order_object&>(before).sell_price;
+}
+
+void limit_order_book_index::object_modified( const object& after )
+{
+   assert( dynamic_cast<const limit_order_object*>(&after) );
+   const limit_order_object& o = static_cast<const limit_order_object&>(after);
+   // fills only change the amount for sale, which leaves the order where it is
+   if( compare_prices( _price_before_modify, o.sell_price ) == 0 )
+      return;
+   remove( o, _price_before_modify );
+   add( o, o.sell_price );
+}
+
+const limit_order_book_index::book_side* limit_order_book_index::find_side( asset_id_type sell_asset,
+                                                                           asset_id_type receive_asset )const
+{
+   auto itr = _books.find( std::make_pair( sell_asset, receive_asset ) );
+   if( itr == _books.end() ) return nullptr;
+   return &itr->second;
+}
+
+const limit_order_object* limit_order_book_index::best_order( asset_id_type sell_asset, asset_id_type receive_asset )const
+{
+   const book_side* side = find_side( sell_asset, receive_asset );
+   if( side == nullptr ) return nullptr;
+   return side->begin()->second.front();
+}
+
+} } // graphene::chain
@@ -31,6 +31,9 @@ namespace graphene { namespace chain {
 
       bool operator == ( const price& a, const price& b )
       {
+#ifdef __SIZEOF_INT128__
+         return compare_prices( a, b ) == 0;
+#else
          if( std::tie( a.base.asset_id, a.quote.asset_id ) != std::tie( b.base.asset_id, b.quote.asset_id ) )
              return false;
 
@@ -38,10 +41,14 @@ namespace graphene { namespace chain {
          const auto bmult = uint128_t( a.quote.amount.value ) * b.base.amount.value;
 
          return amult == bmult;
+#endif
       }
 
       bool operator < ( const price& a, const price& b )
       {
+#ifdef __SIZEOF_INT128__
+         return compare_prices( a, b ) < 0;
+#else
          if( a.base.asset_id < b.base.asset_id ) return true;
          if( a.base.asset_id > b.base.asset_id ) return false;
          if( a.quote.asset_id < b.quote.asset_id ) return true;
@@ -51,11 +58,12 @@ namespace graphene { namespace chain {
          const auto bmult = uint128_t( a.quote.amount.value ) * b.base.amount.value;
 
          return amult < bmult;
+#endif
       }
 
       bool operator <= ( const price& a, const price& b )
       {
-         return (a == b) || (a < b);
+         return compare_prices( a, b ) <= 0;
       }
 
       bool operator != ( const price& a, const price& b )
@@ -65,12 +73,12 @@ namespace graphene { namespace chain {
 
       bool operator > ( const price& a, const price& b )
       {
-         return !(a <= b);
+         return compare_prices( a, b ) > 0;
       }
 
       bool operator >= ( const price& a, const price& b )
       {
-         return !(a < b);
+         return compare_prices( a, b ) >= 0;
       }
 
       asset operator * ( const asset& a, const price& b )
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/protocol/signature_key_cache.hpp>
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+namespace {
+
+   struct cache_key
+   {
+      digest_type    digest;
+      signature_type signature;
+
+      bool operator == ( const cache_key& other )const
+      {
+         return digest == other.digest && signature == other.signature;
+      }
+   };
+
+   struct cache_key_hash
+   {
+      size_t operator()( const cache_key& k )const
+      {
+         // both halves are already uniformly distributed, mixing a few bytes of each is enough
+         uint64_t d, s;
+         memcpy( &d, k.digest.data(), sizeof(d) );
+         memcpy( &s, k.signature.begin() + 1, sizeof(s) );
+         return size_t( d ^ s );
+      }
+   };
+
+   struct key_cache
+   {
+      typedef std::list< std::pair<cache_key,public_key_type> > lru_list;
+
+      std::mutex                                                       mutex;
+      /** most recently used first */
+      lru_list                                                         entries;
+      std::unordered_map<cache_key,lru_list::iterator,cache_key_hash> lookup;
+      uint32_t                                                         capacity = signature_key_cache::default_capacity;
+      uint64_t                                                         hits = 0;
+      uint64_t                                                         misses = 0;
+
+      void trim()
+      {
+         while( entries.size() > capacity )
+         {
+            lookup.erase( entries.back().first );
+            entries.pop_back();
+         }
+      }
+   };
+
+   key_cache& the_cache()
+   {
+      static key_cache cache;
+      return cache;
+   }
+
+} // anonymous namespace
+
+const uint32_t signature_key_cache::default_capacity;
+
+public_key_type signature_key_cache::recover( const signature_type& sig, const digest_type& digest )
+{
+   key_cache& cache = the_cache();
+   cache_key key{ digest, sig };
+   {
+      std::lock_guard<std::mutex> lock( cache.mutex );
+      auto itr = cache.lookup.find( key );
+      if( itr != cache.lookup.end() )
+      {
+         ++cache.hits;
+         cache.entries.splice( cache.entries.begin(), cache.entries, itr->second );
+         return itr->second->second;
+      }
+      ++cache.misses;
+   }
+
+   // recover without holding the lock, signatures are checked on several threads at once
+   public_key_type result = fc::ecc::public_key( sig, digest );
+
+   std::lock_guard<std::mutex> lock( cache.mutex );
+   if( cache.capacity > 0 && cache.lookup.find( key ) == cache.lookup.end() )
+   {
+      cache.entries.emplace_front( key, result );
+      cache.lookup.emplace( key, cache.entries.begin() );
+      cache.trim();
+   }
+   return result;
+}
+
+void signature_key_cache::set_capacity( uint32_t capacity )
+{
+   key_cache& cache = the_cache();
+   std::lock_guard<std::mutex> lock( cache.mutex );
+   cache.capacity = capacity;
+   cache.trim();
+}
+
+signature_key_cache::statistics signature_key_cache::get_statistics()
+{
+   key_cache& cache = the_cache();
+   std::lock_guard<std::mutex> lock( cache.mutex );
+   statistics result;
+   result.hits     = cache.hits;
+   result.misses   = cache.misses;
+   result.size     = cache.entries.size();
+   result.capacity = cache.capacity;
+   return result;
+}
+
+void signature_key_cache::clear()
+{
+   key_cache& cache = the_cache();
+   std::lock_guard<std::mutex> lock( cache.mutex );
+   cache.entries.clear();
+   cache.lookup.clear();
+   cache.hits = 0;
+   cache.misses = 0;
+}
+
+} } // graphene::chain
@@ -23,6 +23,7 @@
  */
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/chain/protocol/signature_key_cache.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/bitutil.hpp>
 #include <fc/smart_ref_impl.hpp>
@@ -302,14 +303,22 @@ void verify_authority( const vector<operation>& ops, const flat_set<public_key_t
 flat_set<public_key_type> signed_transaction::get_signature_keys( const chain_id_type& chain_id )const
 { try {
    auto d = sig_digest( chain_id );
+   if( _signees_valid && _signees_digest == d && _signees_signatures == signatures )
+      return _signees;
+
    flat_set<public_key_type> result;
    for( const auto&  sig : signatures )
    {
       GRAPHENE_ASSERT(
-         result.insert( fc::ecc::public_key(sig,d) ).second,
+         result.insert( signature_key_cache::recover( sig, d ) ).second,
          tx_duplicate_sig,
          "Duplicate Signature detected" );
    }
+
+   _signees_valid = true;
+   _signees_digest = d;
+   _signees_signatures = signatures;
+   _signees = result;
    return result;
 } FC_CAPTURE_AND_RETHROW() }
 
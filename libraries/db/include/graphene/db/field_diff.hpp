@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/exception/exception.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <bitset>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    *  Types for which this is specialized to true are saved in undo states as the old values of
+    *  the reflected fields that modifications changed, instead of as a copy of the whole object.
+    *  This pays off for objects which are modified often, a few fields at a time.
+    */
+   template<typename T>
+   struct undo_field_diffs { static const bool value = false; };
+
+   namespace detail {
+      static const size_t max_diff_fields = 64;
+      static const size_t field_diff_entry_header_size = sizeof(uint16_t) + sizeof(uint32_t);
+
+      /** calls f( field, value, value_size ) for each entry of a field diff */
+      template<typename F>
+      void for_each_field_diff_entry( const char* data, size_t size, F&& f )
+      {
+         size_t pos = 0;
+         while( pos < size )
+         {
+            uint16_t field;
+            uint32_t value_size;
+            memcpy( &field, data + pos, sizeof(field) );
+            memcpy( &value_size, data + pos + sizeof(field), sizeof(value_size) );
+            pos += field_diff_entry_header_size;
+            f( field, data + pos, value_size );
+            pos += value_size;
+         }
+      }
+   }
+
+   /**
+    *  Composes two diffs of the same object, older recorded before newer, into older: the entries
+    *  of newer for fields which older has no entry for are appended, as older holds the earlier
+    *  values of the other fields.
+    */
+   template<typename Buffer>
+   void merge_field_diffs( Buffer& older, const char* newer, size_t size )
+   {
+      std::bitset<detail::max_diff_fields> recorded;
+      detail::for_each_field_diff_entry( older.data(), older.size(), [&]( uint16_t field, const char*, uint32_t ) {
+         recorded.set( field );
+      });
+      detail::for_each_field_diff_entry( newer, size, [&]( uint16_t field, const char* value, uint32_t value_size ) {
+         if( recorded.test( field ) ) return;
+         const char* entry = value - detail::field_diff_entry_header_size;
+         older.insert( older.end(), entry, value + value_size );
+      });
+   }
+
+   /**
+    *  @brief the serialized value of every reflected field of an object
+    *
+    *  Captured just before a modification and compared field by field with the object afterwards
+    *  to find what changed.  A field diff is a sequence of (field index, size, serialized value)
+    *  entries as appended by append_changes() and replayed by apply().
+    *
+    *  The captured values live in buffers reused by the instances for T.  Instances nest, as when
+    *  modifying an object modifies another one of the same type, and each takes the buffers of its
+    *  depth.
+    */
+   template<typename T>
+   class field_values
+   {
+      public:
+         static const size_t max_fields = detail::max_diff_fields;
+
+         explicit field_values( const T& obj ):_values( acquire() )
+         {
+            try {
+               _values.data.clear();
+               _values.ends.clear();
+               fc::reflector<T>::visit( capture_visitor( obj, _values ) );
+            } catch( ... ) {
+               --scratch().depth;
+               throw;
+            }
+         }
+         ~field_values() { --scratch().depth; }
+
+         /**
+          *  Appends to diff the captured value of every field that differs in obj, unless diff
+          *  already holds an older value for that field.
+          */
+         template<typename Buffer>
+         void append_changes( const T& obj, Buffer& diff )const
+         {
+            std::bitset<max_fields> recorded;
+            for_each_entry( diff.data(), diff.size(), [&]( uint16_t field, const char*, uint32_t ) {
+               recorded.set( field );
+            });
+            fc::reflector<T>::visit( compare_visitor<Buffer>( obj, _values, recorded, diff ) );
+         }
+
+         /** restores the old values recorded in a diff into obj */
+         static void apply( T& obj, const char* data, size_t size )
+         {
+            for_each_entry( data, size, [&]( uint16_t field, const char* value, uint32_t value_size ) {
+               fc::reflector<T>::visit( apply_visitor( obj, field, value, value_size ) );
+            });
+         }
+
+      private:
+         struct buffers
+         {
+            std::vector<char>     data;
+            /** end of each field in data */
+            std::vector<uint32_t> ends;
+            std::vector<char>     current;
+         };
+
+         struct scratch_stack
+         {
+            /** buffers of each nesting depth, kept for reuse */
+            std::vector< std::unique_ptr<buffers> > levels;
+            size_t                                  depth = 0;
+         };
+
+         static scratch_stack& scratch()
+         {
+            static scratch_stack s;
+            return s;
+         }
+
+         static buffers& acquire()
+         {
+            scratch_stack& s = scratch();
+            if( s.depth == s.levels.size() )
+               s.levels.emplace_back( new buffers );
+            return *s.levels[s.depth++];
+         }
+
+         template<typename V>
+         static void append_packed( std::vector<char>& out, const V& v )
+         {
+            const size_t pos = out.size();
+            const size_t size = fc::raw::pack_size( v );
+            out.resize( pos + size );
+            fc::datastream<char*> ds( out.data() + pos, size );
+            fc::raw::pack( ds, v );
+         }
+
+         static const size_t entry_header_size = detail::field_diff_entry_header_size;
+
+         template<typename F>
+         static void for_each_entry( const char* data, size_t size, F&& f )
+         {
+            detail::for_each_field_diff_entry( data, size, std::forward<F>( f ) );
+         }
+
+         struct capture_visitor
+         {
+            capture_visitor( const T& o, buffers& v ):obj(o),values(v){}
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* )const
+            {
+               FC_ASSERT( values.ends.size() < max_fields, "Too many fields to record field diffs" );
+               append_packed( values.data, obj.*member );
+               values.ends.push_back( values.data.size() );
+            }
+
+            const T& obj;
+            buffers& values;
+         };
+
+         template<typename Buffer>
+         struct compare_visitor
+         {
+            compare_visitor( const T& o, buffers& v, const std::bitset<max_fields>& r, Buffer& d )
+            :obj(o),values(v),recorded(r),diff(d){}
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* )const
+            {
+               const uint16_t field = next_field++;
+               if( recorded.test( field ) ) return;
+               const uint32_t begin = field == 0 ? 0 : values.ends[field - 1];
+               const uint32_t size  = values.ends[field] - begin;
+               values.current.clear();
+               append_packed( values.current, obj.*member );
+               if( values.current.size() == size && memcmp( values.current.data(), values.data.data() + begin, size ) == 0 )
+                  return;
+
+               char header[entry_header_size];
+               memcpy( header, &field, sizeof(field) );
+               memcpy( header + sizeof(field), &size, sizeof(size) );
+               diff.insert( diff.end(), header, header + entry_header_size );
+               diff.insert( diff.end(), values.data.data() + begin, values.data.data() + begin + size );
+            }
+
+            const T&                        obj;
+            buffers&                        values;
+            const std::bitset<max_fields>&  recorded;
+            Buffer&                         diff;
+            mutable uint16_t                next_field = 0;
+         };
+
+         struct apply_visitor
+         {
+            apply_visitor( T& o, uint16_t f, const char* d, uint32_t s ):obj(o),field(f),data(d),size(s){}
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* )const
+            {
+               if( next_field++ != field ) return;
+               fc::datastream<const char*> ds( data, size );
+               fc::raw::unpack( ds, obj.*member );
+            }
+
+            T&               obj;
+            uint16_t         field;
+            const char*      data;
+            uint32_t         size;
+            mutable uint16_t next_field = 0;
+         };
+
+         buffers& _values;
+   };
+
+} } // graphene::db
@@ -68,8 +68,14 @@ namespace graphene { namespace chain {
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
             assert( nullptr != dynamic_cast<const ObjectType*>(&obj) );
-            auto ok = _indices.modify( _indices.iterator_to( static_cast<const ObjectType&>(obj) ),
-                                       [&m]( ObjectType& o ){ m(o); } );
+            modify( static_cast<const ObjectType&>(obj), [&m]( ObjectType& o ){ m(o); } );
+         }
+
+         /** statically dispatched modify, see primary_index::modify */
+         template<typename Lambda>
+         void modify( const ObjectType& obj, const Lambda& m )
+         {
+            auto ok = _indices.modify( _indices.iterator_to( obj ), [&m]( ObjectType& o ){ m(o); } );
             FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
          }
 
@@ -99,9 +105,10 @@ namespace graphene { namespace chain {
 
          virtual fc::uint128 hash()const override {
             fc::uint128 result;
+            vector<char> buffer;
             for( const auto& ptr : _indices )
             {
-               result += ptr.hash();
+               result += ptr.hash( buffer );
             }
 
             return result;
@@ -112,6 +119,89 @@ namespace graphene { namespace chain {
          index_type  _indices;
    };
 
+   /**
+    * @brief A generic_index which also keeps a table of its objects by instance
+    *
+    * For object types whose instances are allocated sequentially and are rarely removed, such as
+    * accounts and assets, lookup by ID is a vector access instead of a search of the by_id tree.
+    * The multi_index container still owns the objects and provides the other keys; the table
+    * points at its nodes, which do not move while the object exists.
+    */
+   template<typename ObjectType, typename MultiIndexType>
+   class dense_index : public generic_index<ObjectType, MultiIndexType>
+   {
+      typedef generic_index<ObjectType, MultiIndexType> base_type;
+
+      public:
+         virtual const object& insert( object&& obj )override
+         {
+            const object& result = base_type::insert( std::move(obj) );
+            set_slot( result.id.instance(), static_cast<const ObjectType*>( &result ) );
+            return result;
+         }
+
+         virtual const object& create( const std::function<void(object&)>& constructor )override
+         {
+            const object& result = base_type::create( constructor );
+            set_slot( result.id.instance(), static_cast<const ObjectType*>( &result ) );
+            return result;
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& m )override
+         {
+            modify( static_cast<const ObjectType&>(obj), [&m]( ObjectType& o ){ m(o); } );
+         }
+
+         /** statically dispatched modify, see primary_index::modify */
+         template<typename Lambda>
+         void modify( const ObjectType& obj, const Lambda& m )
+         {
+            const object_id_type id = obj.id;
+            try {
+               base_type::modify( obj, m );
+            } catch( ... ) {
+               // the container erases the object when the modification fails
+               if( base_type::find( id ) == nullptr )
+                  set_slot( id.instance(), nullptr );
+               throw;
+            }
+         }
+
+         virtual void remove( const object& obj )override
+         {
+            const uint64_t instance = obj.id.instance();
+            base_type::remove( obj );
+            set_slot( instance, nullptr );
+         }
+
+         virtual const object* find( object_id_type id )const override
+         {
+            if( id.space_type() != ( uint16_t(ObjectType::space_id) << 8 | ObjectType::type_id ) )
+               return nullptr;
+            const uint64_t instance = id.instance();
+            if( instance >= _slots.size() ) return nullptr;
+            return _slots[instance];
+         }
+
+      private:
+         void set_slot( uint64_t instance, const ObjectType* obj )
+         {
+            if( obj == nullptr )
+            {
+               if( instance < _slots.size() )
+                  _slots[instance] = nullptr;
+               while( !_slots.empty() && _slots.back() == nullptr )
+                  _slots.pop_back();
+               return;
+            }
+            if( instance >= _slots.size() )
+               _slots.resize( instance + 1, nullptr );
+            _slots[instance] = obj;
+         }
+
+         vector<const ObjectType*> _slots;
+   };
+
    /**
     * @brief An index type for objects which may be deleted
     *
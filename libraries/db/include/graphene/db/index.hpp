@@ -23,16 +23,57 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/field_diff.hpp>
+#include <graphene/db/undo_database.hpp>
+#include <graphene/db/type_description.hpp>
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
+#include <boost/crc.hpp>
 #include <fstream>
 
 namespace graphene { namespace db {
    class object_database;
    using fc::path;
 
+   /**
+    * @brief fixed size header at the start of every saved index file
+    *
+    * The header is followed by the serialized objects and then by an index_file_table
+    * which starts at table_pos.
+    */
+   struct index_file_header
+   {
+      static const uint32_t current_format = 2;
+      static const uint32_t default_objects_per_block = 1024;
+
+      uint32_t       format = current_format;
+      object_id_type next_id;
+      /** hash of the reflected layout of the object type */
+      fc::sha256     schema;
+      uint64_t       object_count = 0;
+      /** number of consecutive objects covered by each checksum */
+      uint32_t       objects_per_block = default_objects_per_block;
+      uint64_t       table_pos = 0;
+      uint32_t       table_checksum = 0;
+
+      static uint32_t checksum( const char* data, size_t size )
+      {
+         boost::crc_32_type crc;
+         crc.process_bytes( data, size );
+         return crc.checksum();
+      }
+   };
+
+   struct index_file_table
+   {
+      /** file position of every object, followed by the end of the last object */
+      vector<uint64_t> offsets;
+      /** checksum of the serialized objects of each block */
+      vector<uint32_t> block_checksums;
+   };
+
    /**
     * @class index_observer
     * @brief used to get callbacks when objects change
@@ -78,6 +119,17 @@ namespace graphene { namespace db {
          virtual void           set_next_id( object_id_type id ) = 0;
 
          virtual const object&  load( const std::vector<char>& data ) = 0;
+         /**
+          *  Inserts an object from its serialized form or replaces the existing object with the
+          *  same ID.  No undo state is recorded and observers are not notified; this is used
+          *  to replay the object journal on open.
+          */
+         virtual const object&  restore( const std::vector<char>& data ) = 0;
+         /**
+          *  Removes the object with id without recording undo state, does nothing if the
+          *  object does not exist.
+          */
+         virtual void           discard( object_id_type id ) = 0;
          /**
           *  Polymorphically insert by moving an object into the index.
           *  this should throw if the object is already in the database.
@@ -132,6 +184,12 @@ namespace graphene { namespace db {
 
          virtual void               object_from_variant( const fc::variant& var, object& obj )const = 0;
          virtual void               object_default( object& obj )const = 0;
+         /** hash of the reflected layout of the object type, as recorded in saved index files */
+         virtual fc::sha256         get_object_version()const = 0;
+         /** restores the old field values recorded by a field diff into obj */
+         virtual void               apply_field_diff( object& obj, const char* data, size_t size )const = 0;
+         /** decodes an object serialized by save() into a variant */
+         virtual fc::variant        serialized_to_variant( const char* data, size_t size )const = 0;
    };
 
    class secondary_index
@@ -154,6 +212,8 @@ namespace graphene { namespace db {
 
          /** called just before obj is modified */
          void save_undo( const object& obj );
+         /** called instead of save_undo() for types which record field diffs */
+         field_diff* save_undo_fields( const object& obj );
 
          /** called just after the object is added */
          void on_add( const object& obj );
@@ -217,31 +277,71 @@ namespace graphene { namespace db {
          virtual void           use_next_id()override                    { ++_next_id.number;  }
          virtual void           set_next_id( object_id_type id )override { _next_id = id;      }
 
-         fc::sha256 get_object_version()const
+         virtual fc::sha256 get_object_version()const override
          {
-            std::string desc = "1.0";//get_type_description<object_type>();
-            return fc::sha256::hash(desc);
+            static const fc::sha256 version = fc::sha256::hash( get_type_description<object_type>() );
+            return version;
          }
 
+         /**
+          *  Loads an index file written by save().  The header, the offset table and the checksum
+          *  of every block are verified before any object is inserted, so a truncated or corrupt
+          *  file is rejected as a whole instead of being partially loaded.
+          */
          virtual void open( const path& db )override
          { 
             if( !fc::exists( db ) ) return;
+            const uint64_t file_size = fc::file_size( db );
+            index_file_header header;
+            FC_ASSERT( file_size >= fc::raw::pack_size( header ), "Index file is truncated", ("file",db) );
+
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
-            fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
-            fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
-            fc::sha256 open_ver;
-
-            fc::raw::unpack(ds, _next_id);
-            fc::raw::unpack(ds, open_ver);
-            FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            try {
-               vector<char> tmp;
-               while( true ) 
-               {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
-               }
-            } catch ( const fc::exception&  ){}
+            fc::mapped_region mr( fm, fc::read_only, 0, file_size );
+            const char* data = (const char*)mr.get_address();
+            fc::datastream<const char*> ds( data, file_size );
+
+            fc::raw::unpack( ds, header );
+            FC_ASSERT( header.format == index_file_header::current_format, "Unsupported index file format",
+                       ("file",db)("format",header.format) );
+            FC_ASSERT( header.schema == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+            FC_ASSERT( header.table_pos >= ds.tellp() && header.table_pos <= file_size, "Index file is truncated", ("file",db) );
+
+            const uint64_t table_size = file_size - header.table_pos;
+            FC_ASSERT( index_file_header::checksum( data + header.table_pos, table_size ) == header.table_checksum,
+                       "Index file offset table is corrupt", ("file",db) );
+            index_file_table table;
+            fc::datastream<const char*> table_ds( data + header.table_pos, table_size );
+            fc::raw::unpack( table_ds, table );
+
+            const uint64_t count = header.object_count;
+            const uint64_t block_size = header.objects_per_block;
+            FC_ASSERT( block_size > 0
+                       && table.offsets.size() == count + 1
+                       && table.block_checksums.size() == ( count + block_size - 1 ) / block_size
+                       && table.offsets.front() == ds.tellp()
+                       && table.offsets.back() == header.table_pos,
+                       "Index file offset table is inconsistent", ("file",db)("count",count) );
+            for( uint64_t i = 0; i < count; ++i )
+               FC_ASSERT( table.offsets[i] <= table.offsets[i+1], "Index file offset table is inconsistent", ("file",db)("object",i) );
+
+            for( uint64_t b = 0; b < table.block_checksums.size(); ++b )
+            {
+               const uint64_t begin = table.offsets[ b * block_size ];
+               const uint64_t end   = table.offsets[ std::min( count, (b + 1) * block_size ) ];
+               FC_ASSERT( index_file_header::checksum( data + begin, end - begin ) == table.block_checksums[b],
+                          "Index file is corrupt", ("file",db)("block",b) );
+            }
+
+            _next_id = header.next_id;
+            for( uint64_t i = 0; i < count; ++i )
+            {
+               // decode straight from the mapped file, bounded by the object's offsets
+               fc::datastream<const char*> object_ds( data + table.offsets[i], table.offsets[i+1] - table.offsets[i] );
+               object_type obj;
+               fc::raw::unpack( object_ds, obj );
+               FC_ASSERT( object_ds.remaining() == 0, "Object does not match its recorded size", ("file",db)("object",i) );
+               insert_loaded( std::move( obj ) );
+            }
          }
 
          virtual void save( const path& db ) override 
@@ -249,25 +349,78 @@ namespace graphene { namespace db {
             std::ofstream out( db.generic_string(), 
                                std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
             FC_ASSERT( out );
-            auto ver  = get_object_version();
-            fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
+            index_file_header header;
+            header.next_id = _next_id;
+            header.schema  = get_object_version();
+            // written again below, once the object count and table position are known
+            fc::raw::pack( out, header );
+
+            index_file_table   table;
+            uint64_t           pos = fc::raw::pack_size( header );
+            boost::crc_32_type crc;
             this->inspect_all_objects( [&]( const object& o ) {
                 auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
+                out.write( vec.data(), vec.size() );
+                table.offsets.push_back( pos );
+                pos += vec.size();
+                crc.process_bytes( vec.data(), vec.size() );
+                if( table.offsets.size() % header.objects_per_block == 0 )
+                {
+                   table.block_checksums.push_back( crc.checksum() );
+                   crc.reset();
+                }
             });
+            if( table.offsets.size() % header.objects_per_block != 0 )
+               table.block_checksums.push_back( crc.checksum() );
+            header.object_count = table.offsets.size();
+            table.offsets.push_back( pos );
+
+            auto table_data = fc::raw::pack( table );
+            out.write( table_data.data(), table_data.size() );
+            header.table_pos = pos;
+            header.table_checksum = index_file_header::checksum( table_data.data(), table_data.size() );
+            out.seekp( 0 );
+            fc::raw::pack( out, header );
+            FC_ASSERT( out, "Unable to write index file", ("file",db) );
          }
 
          virtual const object&  load( const std::vector<char>& data )override
          {
-            const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
+            return insert_loaded( fc::raw::unpack<object_type>( data ) );
+         }
+
+         virtual const object&  restore( const std::vector<char>& data )override
+         {
+            auto obj = fc::raw::unpack<object_type>( data );
+            const object* existing = DerivedIndex::find( obj.id );
+            if( existing == nullptr )
+               return insert_loaded( std::move( obj ) );
+            for( const auto& item : _sindex )
+               item->about_to_modify( *existing );
+            DerivedIndex::modify( *existing, [&]( object& o ){ o.move_from( obj ); } );
+            for( const auto& item : _sindex )
+               item->object_modified( *existing );
+            return *existing;
+         }
+
+         virtual void discard( object_id_type id )override
+         {
+            const object* existing = DerivedIndex::find( id );
+            if( existing == nullptr ) return;
+            for( const auto& item : _sindex )
+               item->object_removed( *existing );
+            DerivedIndex::remove( *existing );
+         }
+
+         /** used by the undo database to put back removed objects, which secondary indexes must see again */
+         virtual const object&  insert( object&& obj )override
+         {
+            const auto& result = DerivedIndex::insert( std::move( obj ) );
             for( const auto& item : _sindex )
                item->object_inserted( result );
             return result;
          }
 
-
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
             const auto& result = DerivedIndex::create( constructor );
@@ -287,13 +440,40 @@ namespace graphene { namespace db {
 
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
-            save_undo( obj );
-            for( const auto& item : _sindex )
-               item->about_to_modify( obj );
-            DerivedIndex::modify( obj, m );
-            for( const auto& item : _sindex )
-               item->object_modified( obj );
-            on_modify( obj );
+            modify( static_cast<const object_type&>( obj ), [&m]( object_type& o ){ m( o ); } );
+         }
+
+         /**
+          *  Statically dispatched modify, used by object_database::modify_in() when the index type
+          *  is known at compile time.  Records undo state and notifies secondary indexes and observers
+          *  like the virtual modify, without wrapping the lambda in std::function or calling through
+          *  the index vtable.
+          */
+         template<typename Lambda>
+         void modify( const object_type& obj, const Lambda& m )
+         {
+            if( undo_field_diffs<object_type>::value )
+            {
+               field_diff* diff = save_undo_fields( obj );
+               if( diff != nullptr )
+               {
+                  const object_id_type id = obj.id;
+                  const field_values<object_type> before( obj );
+                  try {
+                     modify_and_notify( obj, m );
+                  } catch( ... ) {
+                     // a multi_index container erases the object when its modification fails
+                     if( DerivedIndex::find( id ) == &obj )
+                        before.append_changes( obj, *diff );
+                     throw;
+                  }
+                  before.append_changes( obj, *diff );
+                  return;
+               }
+            }
+            else
+               save_undo( obj );
+            modify_and_notify( obj, m );
          }
 
          virtual void add_observer( const shared_ptr<index_observer>& o ) override
@@ -319,8 +499,45 @@ namespace graphene { namespace db {
             obj.id = id;
          }
 
+         virtual void apply_field_diff( object& obj, const char* data, size_t size )const override
+         {
+            field_values<object_type>::apply( static_cast<object_type&>( obj ), data, size );
+         }
+
+         virtual fc::variant serialized_to_variant( const char* data, size_t size )const override
+         {
+            fc::datastream<const char*> ds( data, size );
+            object_type obj;
+            fc::raw::unpack( ds, obj );
+            return fc::variant( obj );
+         }
+
       private:
+         template<typename Lambda>
+         void modify_and_notify( const object_type& obj, const Lambda& m )
+         {
+            for( const auto& item : _sindex )
+               item->about_to_modify( obj );
+            DerivedIndex::modify( obj, m );
+            for( const auto& item : _sindex )
+               item->object_modified( obj );
+            if( !_observers.empty() )
+               on_modify( obj );
+         }
+
+         const object& insert_loaded( object_type&& obj )
+         {
+            const auto& result = DerivedIndex::insert( std::move( obj ) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            return result;
+         }
+
          object_id_type _next_id;
    };
 
 } } // graphene::db
+
+FC_REFLECT( graphene::db::index_file_header,
+            (format)(next_id)(schema)(object_count)(objects_per_block)(table_pos)(table_checksum) )
+FC_REFLECT( graphene::db::index_file_table, (offsets)(block_checksums) )
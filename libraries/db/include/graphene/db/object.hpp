@@ -29,6 +29,17 @@
 
 namespace graphene { namespace db {
 
+   /**
+    *  @brief source of memory for copies of objects made with object::clone( object_allocator& )
+    */
+   class object_allocator
+   {
+      public:
+         virtual ~object_allocator(){}
+         virtual void* allocate( size_t size ) = 0;
+         virtual void  deallocate( void* p, size_t size ) = 0;
+   };
+
    /**
     *  @brief base for all database objects
     *
@@ -72,10 +83,14 @@ namespace graphene { namespace db {
 
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
+         /// copies the object into memory obtained from alloc, the caller destroys and deallocates it
+         virtual object*            clone( object_allocator& alloc )const = 0;
          virtual void               move_from( object& obj ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
          virtual fc::uint128        hash()const = 0;
+         /// same as hash(), serializing into buffer so that it can be reused for many objects
+         virtual fc::uint128        hash( vector<char>& buffer )const = 0;
    };
 
    /**
@@ -94,6 +109,17 @@ namespace graphene { namespace db {
             return unique_ptr<object>(new DerivedClass( *static_cast<const DerivedClass*>(this) ));
          }
 
+         virtual object* clone( object_allocator& alloc )const
+         {
+            void* p = alloc.allocate( sizeof(DerivedClass) );
+            try {
+               return new (p) DerivedClass( *static_cast<const DerivedClass*>(this) );
+            } catch( ... ) {
+               alloc.deallocate( p, sizeof(DerivedClass) );
+               throw;
+            }
+         }
+
          virtual void    move_from( object& obj )
          {
             static_cast<DerivedClass&>(*this) = std::move( static_cast<DerivedClass&>(obj) );
@@ -101,8 +127,15 @@ namespace graphene { namespace db {
          virtual variant to_variant()const { return variant( static_cast<const DerivedClass&>(*this) ); }
          virtual vector<char> pack()const  { return fc::raw::pack( static_cast<const DerivedClass&>(*this) ); }
          virtual fc::uint128  hash()const  {  
-             auto tmp = this->pack();
-             return fc::city_hash_crc_128( tmp.data(), tmp.size() );
+             vector<char> tmp;
+             return hash( tmp );
+         }
+         virtual fc::uint128  hash( vector<char>& buffer )const {
+             const DerivedClass& self = static_cast<const DerivedClass&>(*this);
+             buffer.resize( fc::raw::pack_size( self ) );
+             fc::datastream<char*> ds( buffer.data(), buffer.size() );
+             fc::raw::pack( ds, self );
+             return fc::city_hash_crc_128( buffer.data(), buffer.size() );
          }
    };
 
@@ -25,9 +25,12 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/index.hpp>
 #include <graphene/db/undo_database.hpp>
+#include <graphene/db/thread_pool.hpp>
 
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
 
+#include <cstdio>
 #include <map>
 
 namespace graphene { namespace db {
@@ -42,17 +45,45 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes() { _index.clear(); _index.resize(255); _state_hash_valid = false; }
 
          void open(const fc::path& data_dir );
 
          /**
           * Saves the complete state of the object_database to disk, this could take a while
+          *
+          * The files are written to a new directory which then replaces object_database, files
+          * that were written before are never changed.
           */
          void flush();
+         /**
+          * The file in a flushed object_database directory which holds a number that identifies
+          * the flush() which wrote the directory, 0 if there is none
+          */
+         static fc::path flush_id_path( const fc::path& data_dir ) { return data_dir / "object_database" / "flush_id"; }
+         static uint64_t read_flush_id( const fc::path& data_dir );
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /**
+          * Enables the append-only object journal.  Must be called before open().
+          *
+          * While the journal is enabled every committed undo state is appended to
+          * object_database/journal as a delta of the objects it touched, so persist()
+          * only costs time proportional to what changed since the last flush().  The
+          * journal is synced to disk after each commit and pop.  On open() it is replayed
+          * on top of the last full flush.  Once it has grown beyond compact_size bytes it
+          * is compacted into a new flush, on open() or after the commit which crossed it.
+          */
+         void enable_journal( uint64_t compact_size );
+         bool journal_enabled()const { return _journal_enabled; }
+
+         /**
+          * Makes the current state durable.  This only syncs the journal when it is enabled
+          * and describes the current state, otherwise it performs a full flush().
+          */
+         void persist();
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -90,6 +121,17 @@ namespace graphene { namespace db {
          void modify( const T& obj, const Lambda& m ) {
             get_mutable_index(obj.id).modify(obj,m);
          }
+         /**
+          *  Modifies an object of a primary_index<IndexType>, which must be the index registered for
+          *  its type.  Knowing the index type statically avoids the std::function wrapping and the
+          *  virtual calls of modify(); use it on hot paths.
+          */
+         template<typename IndexType, typename Lambda>
+         void modify_in( const typename IndexType::object_type& obj, const Lambda& m ) {
+            index& idx = get_mutable_index( obj.id );
+            assert( nullptr != dynamic_cast<primary_index<IndexType>*>( &idx ) );
+            static_cast<primary_index<IndexType>&>( idx ).modify( obj, m );
+         }
 
          ///@}
 
@@ -136,6 +178,7 @@ namespace graphene { namespace db {
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
             unique_ptr<index> indexptr( new IndexType(*this) );
             _index[ObjectType::space_id][ObjectType::type_id] = std::move(indexptr);
+            _state_hash_valid = false;
             return static_cast<IndexType*>(_index[ObjectType::space_id][ObjectType::type_id].get());
          }
 
@@ -143,6 +186,21 @@ namespace graphene { namespace db {
 
          fc::path get_data_dir()const { return _data_dir; }
 
+         /** worker threads shared by the database for work that can be done in parallel, created on first use */
+         thread_pool& get_thread_pool();
+
+         /**
+          * Digest of the complete object state as of the last committed undo state, i.e. without the
+          * changes of active sessions.  Nodes which have the same indexes registered agree on it at
+          * the same block.
+          *
+          * Each index is summarized by the sum of the hashes of its objects, and the index hashes are
+          * combined in space and type order.  The first call hashes all indexes in parallel.  From then
+          * on the index hashes are updated with the objects changed by every committed undo state, so
+          * later calls are cheap.  Changes made outside of undo sessions make the next call start over.
+          */
+         fc::sha256 state_digest();
+
          /** public for testing purposes only... should be private in practice. */
          undo_database                          _undo_db;
      protected:
@@ -161,11 +219,63 @@ namespace graphene { namespace db {
          friend class base_primary_index;
          friend class undo_database;
          void save_undo( const object& obj );
+         field_diff* save_undo_fields( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         /// Object journal, called by undo_database
+         /// @{
+         void journal_commit( const undo_state& state );
+         /** syncs the records of the states committed last, or compacts the journal if it has grown too big */
+         void journal_sync();
+         void journal_pop( const undo_state& state );
+         /// @}
+
+         /// Incremental state hashes, called by undo_database
+         /// @{
+         void state_hash_commit( undo_database::const_state_iterator first, undo_database::const_state_iterator last );
+         void state_hash_pop( const undo_state& state );
+         /// @}
+
+         /** called by undo_database for changes that are not recorded in a committed undo state */
+         void on_untracked_change()
+         {
+            if( _journal_enabled && !_journal_stale )
+               invalidate_journal();
+            _state_hash_valid = false;
+         }
+
+         void open_journal();
+         void close_journal();
+         void replay_journal();
+         void invalidate_journal();
+         fc::path journal_path()const { return _data_dir / "object_database" / "journal"; }
+
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+
+         std::FILE*                                                _journal = nullptr;
+         /** bytes in the journal file, including those still buffered */
+         uint64_t                                                  _journal_size = 0;
+         bool                                                      _journal_enabled = false;
+         /** set when the state was changed in a way the journal can not reproduce */
+         bool                                                      _journal_stale = false;
+         uint64_t                                                  _journal_compact_size = 0;
+
+         unique_ptr<thread_pool>                                   _thread_pool;
+
+         typedef vector< vector<fc::uint128> > index_hash_table;
+         /**
+          * Adds the hash changes of the objects touched by the states in [first, last) to hashes, or
+          * subtracts them if revert is set.  The states must be the newest ones on the undo stack.
+          * @return false if the changes could not be determined
+          */
+         template<typename StateIterator>
+         bool hash_changes( StateIterator first, StateIterator last, bool revert, index_hash_table& hashes )const;
+
+         /** hashes of the indexes as of the last committed undo state, valid if _state_hash_valid is set */
+         index_hash_table                                          _index_hashes;
+         bool                                                      _state_hash_valid = false;
    };
 
 } } // graphene::db
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+#include <fc/optional.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class object_snapshot
+    * @brief read-only view of the index files written by object_database::flush()
+    *
+    * Every index file is mapped read-only and objects are decoded on demand straight from
+    * the mapping, located through the offset table of the file.  Nothing is loaded onto the
+    * heap, so any number of processes on one host can serve queries from a single page cache
+    * copy of the state.  The snapshot reflects the state at the time of the flush.
+    *
+    * flush() writes a new directory and renames it into place, so the mapped files are never
+    * written to while mapped; a file that has been replaced stays readable through its mapping
+    * until the snapshot is closed.  Compare flush_id() with object_database::read_flush_id() to
+    * find out whether a newer flush is available.
+    */
+   class object_snapshot
+   {
+      public:
+         /** serialized objects of one index file, as mapped from disk */
+         class mapped_index
+         {
+            public:
+               mapped_index( const fc::path& file );
+
+               const index_file_header& header()const { return _header; }
+               uint64_t                 size()const   { return _header.object_count; }
+
+               /** ID of the n-th object in the file, read from the start of its serialized form */
+               object_id_type id_at( uint64_t n )const;
+               /** position of the object with the given ID, or size() if it is not in the file */
+               uint64_t       position_of( object_id_type id )const;
+
+               const char*    object_data( uint64_t n )const { return _data + offset( n ); }
+               size_t         object_size( uint64_t n )const { return offset( n + 1 ) - offset( n ); }
+
+            private:
+               uint64_t offset( uint64_t n )const;
+
+               std::unique_ptr<fc::file_mapping>  _file;
+               std::unique_ptr<fc::mapped_region> _region;
+               const char*                        _data = nullptr;
+               /** the offsets of the index_file_table, used in place inside the mapping */
+               const char*                        _offsets = nullptr;
+               index_file_header                  _header;
+         };
+
+         object_snapshot();
+         ~object_snapshot();
+
+         /**
+          * Maps the index files found in data_dir/object_database.  Only the headers and offset
+          * tables are checked here; object data is paged in as it is read.
+          */
+         void open( const fc::path& data_dir );
+         void close();
+
+         /** identifies the flush the snapshot was opened from, 0 if it is not known */
+         uint64_t flush_id()const { return _flush_id; }
+
+         /** @return the mapped index file for space/type, nullptr if the snapshot has none */
+         const mapped_index* get_index( uint8_t space_id, uint8_t type_id )const;
+
+         /**
+          * Locates the serialized form of the object with the given ID.
+          * @return false if the object is not in the snapshot
+          */
+         bool find_serialized( object_id_type id, const char*& data, size_t& size )const;
+
+         template<typename T>
+         fc::optional<T> find( object_id_type id )const
+         {
+            const mapped_index* idx = get_index( T::space_id, T::type_id );
+            if( idx == nullptr ) return fc::optional<T>();
+            const uint64_t pos = idx->position_of( id );
+            if( pos == idx->size() ) return fc::optional<T>();
+            return get<T>( *idx, pos );
+         }
+
+         /** decodes the n-th object of idx, which must hold objects of type T */
+         template<typename T>
+         static T get( const mapped_index& idx, uint64_t n )
+         {
+            static const fc::sha256 schema = fc::sha256::hash( get_type_description<T>() );
+            FC_ASSERT( idx.header().schema == schema,
+                       "Incompatible Version, the serialization of objects in this snapshot has changed" );
+            fc::datastream<const char*> ds( idx.object_data( n ), idx.object_size( n ) );
+            T result;
+            fc::raw::unpack( ds, result );
+            return result;
+         }
+
+         /**
+          * Positions of all objects of type T, sorted by a 64 bit key computed from each object.
+          * Pairs are (key, position); use it to look objects up by something other than their ID
+          * while keeping only the key table in memory.
+          */
+         typedef vector< std::pair<uint64_t,uint64_t> > key_table;
+
+         template<typename T, typename KeyOf>
+         key_table build_key_table( KeyOf&& key_of )const
+         {
+            key_table result;
+            const mapped_index* idx = get_index( T::space_id, T::type_id );
+            if( idx == nullptr ) return result;
+            result.reserve( idx->size() );
+            for( uint64_t n = 0; n < idx->size(); ++n )
+               result.emplace_back( key_of( get<T>( *idx, n ) ), n );
+            std::sort( result.begin(), result.end() );
+            return result;
+         }
+
+      private:
+         vector< vector< std::unique_ptr<mapped_index> > > _indexes;
+         uint64_t                                          _flush_id = 0;
+   };
+
+} } // graphene::db
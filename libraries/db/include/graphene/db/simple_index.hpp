@@ -24,15 +24,19 @@
 #pragma once
 #include <graphene/db/index.hpp>
 
+#include <bitset>
+#include <type_traits>
+
 namespace graphene { namespace db {
 
    /**
     *  @class simple_index
-    *  @brief A simple index uses a vector<unique_ptr<T>> to store data
+    *  @brief A simple index stores objects in slabs of contiguous slots, addressed by instance
     *
-    *  This index is preferred in situations where the data will never be
-    *  removed from main memory and when access by ID is the only kind
-    *  of access that is necessary.
+    *  This index is preferred in situations where access by ID is the only kind of access that
+    *  is necessary and instances are allocated sequentially.  Objects never move once created, so
+    *  references to them stay valid until they are removed.  Removed objects leave a tombstone in
+    *  their slot, and a slab is released once all of its objects have been removed.
     */
    template<typename T>
    class simple_index : public index
@@ -40,82 +44,109 @@ namespace graphene { namespace db {
       public:
          typedef T object_type;
 
+         /** number of objects in each slab, about 16 KiB worth */
+         static const size_t slab_size = sizeof(T) >= 16 * 1024 ? 1 : 16 * 1024 / sizeof(T);
+
+         simple_index(){}
+         ~simple_index()
+         {
+            for( uint64_t s = 0; s < _slabs.size(); ++s )
+               release_slab( s );
+         }
+
          virtual const object&  create( const std::function<void(object&)>& constructor ) override
          {
              auto id = get_next_id();
-             auto instance = id.instance();
-             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].reset(new T);
-             _objects[instance]->id = id;
-             constructor( *_objects[instance] );
-             _objects[instance]->id = id; // just in case it changed
+             const uint64_t instance = id.instance();
+             T* obj = new ( allocate_slot( instance ) ) T();
+             try {
+                obj->id = id;
+                constructor( *obj );
+                obj->id = id; // just in case it changed
+             } catch( ... ) {
+                free_slot( instance );
+                throw;
+             }
              use_next_id();
-             return *_objects[instance];
+             return *obj;
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
          {
-            assert( obj.id.instance() < _objects.size() );
-            modify_callback( *_objects[obj.id.instance()] );
+            modify_callback( *get_live( obj.id.instance() ) );
+         }
+
+         /** statically dispatched modify, see primary_index::modify */
+         template<typename Lambda>
+         void modify( const T& obj, const Lambda& modify_callback )
+         {
+            modify_callback( *get_live( obj.id.instance() ) );
          }
 
          virtual const object& insert( object&& obj )override
          {
-            auto instance = obj.id.instance();
             assert( nullptr != dynamic_cast<T*>(&obj) );
-            if( _objects.size() <= instance ) _objects.resize( instance+1 );
-            assert( !_objects[instance] );
-            _objects[instance].reset( new T( std::move( static_cast<T&>(obj) ) ) );
-            return *_objects[instance];
+            const uint64_t instance = obj.id.instance();
+            void* slot = allocate_slot( instance );
+            try {
+               return *new ( slot ) T( std::move( static_cast<T&>(obj) ) );
+            } catch( ... ) {
+               discard_slot( instance );
+               throw;
+            }
          }
 
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
-            const auto instance = obj.id.instance();
-            _objects[instance].reset();
-            while( (_objects.size() > 0) && (_objects.back() == nullptr) )
-               _objects.pop_back();
+            const uint64_t instance = obj.id.instance();
+            get_live( instance );
+            free_slot( instance );
          }
 
          virtual const object* find( object_id_type id )const override
          {
             assert( id.space() == T::space_id );
             assert( id.type() == T::type_id );
-
-            const auto instance = id.instance();
-            if( instance >= _objects.size() ) return nullptr;
-            return _objects[instance].get();
+            return find_instance( id.instance() );
          }
 
          virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
          {
             try {
-               for( const auto& ptr : _objects )
-               {
-                  if( ptr.get() )
-                     inspector(*ptr);
-               }
+               for( const T& obj : *this )
+                  inspector( obj );
             } FC_CAPTURE_AND_RETHROW()
          }
+
          virtual fc::uint128 hash()const override {
             fc::uint128 result;
-            for( const auto& ptr : _objects )
-               result += ptr->hash();
-
+            vector<char> buffer;
+            for( const T& obj : *this )
+               result += obj.hash( buffer );
             return result;
          }
 
+         /** iterates over the objects in the index in ID order, skipping removed instances */
          class const_iterator
          {
             public:
-               const_iterator( const vector<unique_ptr<object>>& objects ):_objects(objects) {}
-               const_iterator(
-                  const vector<unique_ptr<object>>& objects,
-                  const vector<unique_ptr<object>>::const_iterator& a ):_itr(a),_objects(objects){}
-               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
-               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
-               const T& operator*()const { return static_cast<const T&>(*_itr->get()); }
+               typedef std::forward_iterator_tag iterator_category;
+               typedef T                         value_type;
+               typedef std::ptrdiff_t            difference_type;
+               typedef const T*                  pointer;
+               typedef const T&                  reference;
+
+               const_iterator():_index(nullptr),_instance(0){}
+               const_iterator( const simple_index& idx, uint64_t instance ):_index(&idx),_instance(instance)
+               {
+                  skip_removed();
+               }
+
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._instance == b._instance; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._instance != b._instance; }
+               const T& operator*()const  { return *_index->find_instance( _instance ); }
+               const T* operator->()const { return _index->find_instance( _instance ); }
                const_iterator operator++(int)     // postfix
                {
                   const_iterator result( *this );
@@ -124,26 +155,119 @@ namespace graphene { namespace db {
                }
                const_iterator& operator++()       // prefix
                {
-                  ++_itr;
-                  while( (_itr != _objects.end()) && ( (*_itr) == nullptr ) )
-                     ++_itr;
+                  ++_instance;
+                  skip_removed();
                   return *this;
                }
-               typedef std::forward_iterator_tag iterator_category;
-               typedef vector<unique_ptr<object> >::value_type value_type;
-               typedef vector<unique_ptr<object> >::difference_type difference_type;
-               typedef vector<unique_ptr<object> >::pointer pointer;
-               typedef vector<unique_ptr<object> >::reference reference;
+
             private:
-               vector<unique_ptr<object>>::const_iterator _itr;
-               const vector<unique_ptr<object>>& _objects;
+               void skip_removed()
+               {
+                  const uint64_t end = _index->end_instance();
+                  while( _instance < end )
+                  {
+                     const slab* s = _index->_slabs[_instance / slab_size].get();
+                     if( s == nullptr )
+                        _instance = ( _instance / slab_size + 1 ) * slab_size;
+                     else if( !s->live.test( _instance % slab_size ) )
+                        ++_instance;
+                     else
+                        return;
+                  }
+                  _instance = end;
+               }
+
+               const simple_index* _index;
+               uint64_t            _instance;
          };
-         const_iterator begin()const { return const_iterator(_objects, _objects.begin()); }
-         const_iterator end()const   { return const_iterator(_objects, _objects.end());   }
+         const_iterator begin()const { return const_iterator( *this, 0 ); }
+         const_iterator end()const   { return const_iterator( *this, end_instance() ); }
+
+         /** number of objects in the index */
+         size_t size()const { return _size; }
 
-         size_t size()const { return _objects.size(); }
       private:
-         vector< unique_ptr<object> > _objects;
+         struct slab
+         {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[slab_size];
+            std::bitset<slab_size>                                       live;
+            size_t                                                       count = 0;
+
+            T* at( size_t i ) { return reinterpret_cast<T*>( &slots[i] ); }
+            const T* at( size_t i )const { return reinterpret_cast<const T*>( &slots[i] ); }
+         };
+
+         uint64_t end_instance()const { return _slabs.size() * slab_size; }
+
+         const T* find_instance( uint64_t instance )const
+         {
+            const uint64_t s = instance / slab_size;
+            if( s >= _slabs.size() || _slabs[s] == nullptr ) return nullptr;
+            const slab& sl = *_slabs[s];
+            if( !sl.live.test( instance % slab_size ) ) return nullptr;
+            return sl.at( instance % slab_size );
+         }
+
+         T* get_live( uint64_t instance )
+         {
+            const T* obj = find_instance( instance );
+            FC_ASSERT( obj != nullptr, "Object does not exist in this index", ("instance",instance) );
+            return const_cast<T*>( obj );
+         }
+
+         /** reserves the slot of instance, which must be free */
+         void* allocate_slot( uint64_t instance )
+         {
+            const uint64_t s = instance / slab_size;
+            if( s >= _slabs.size() ) _slabs.resize( s + 1 );
+            if( _slabs[s] == nullptr ) _slabs[s].reset( new slab );
+            slab& sl = *_slabs[s];
+            FC_ASSERT( !sl.live.test( instance % slab_size ),
+                       "Could not insert object, an object with the same ID already exists", ("instance",instance) );
+            sl.live.set( instance % slab_size );
+            ++sl.count;
+            ++_size;
+            return sl.at( instance % slab_size );
+         }
+
+         /** releases a slot reserved by allocate_slot() whose object was not constructed */
+         void discard_slot( uint64_t instance )
+         {
+            slab& sl = *_slabs[instance / slab_size];
+            sl.live.reset( instance % slab_size );
+            --sl.count;
+            --_size;
+            trim( instance / slab_size );
+         }
+
+         /** destroys the object in the slot of instance and releases the slot */
+         void free_slot( uint64_t instance )
+         {
+            _slabs[instance / slab_size]->at( instance % slab_size )->~T();
+            discard_slot( instance );
+         }
+
+         /** releases slab s if it is empty, and any empty slabs at the end */
+         void trim( uint64_t s )
+         {
+            if( _slabs[s]->count == 0 )
+               _slabs[s].reset();
+            while( !_slabs.empty() && _slabs.back() == nullptr )
+               _slabs.pop_back();
+         }
+
+         void release_slab( uint64_t s )
+         {
+            if( _slabs[s] == nullptr ) return;
+            slab& sl = *_slabs[s];
+            for( size_t i = 0; i < slab_size; ++i )
+               if( sl.live.test( i ) )
+                  sl.at( i )->~T();
+            _slabs[s].reset();
+         }
+
+         vector< unique_ptr<slab> > _slabs;
+         size_t                     _size = 0;
    };
 
 } } // graphene::db
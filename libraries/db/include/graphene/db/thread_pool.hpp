@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    * @class thread_pool
+    * @brief a fixed set of worker threads for CPU bound work that can be split into independent items
+    *
+    * The workers are plain OS threads rather than fc::threads, and callers block without yielding
+    * to other fc tasks while they wait, so the pool can be used while the database is in the middle
+    * of applying a block.  Work items must not touch the object_database unless the caller
+    * guarantees that no two items access the same index.
+    */
+   class thread_pool
+   {
+      public:
+         /** @param thread_count number of worker threads, 0 to use one per hardware thread */
+         explicit thread_pool( uint32_t thread_count = 0 );
+         ~thread_pool();
+
+         uint32_t size()const { return _threads.size(); }
+
+         /**
+          * Calls f(i) for every i in [0, count) on the worker threads and returns once all calls
+          * are done.  Items are handed out one at a time, so they may differ a lot in cost.  If any
+          * call throws, no further items are started and the first exception is rethrown.
+          *
+          * @note must not be called from a task that runs on the same pool
+          */
+         void parallel_for( size_t count, const std::function<void(size_t)>& f );
+
+      private:
+         void worker_loop();
+
+         std::vector<std::thread>             _threads;
+         std::mutex                           _mutex;
+         std::condition_variable              _work_cv;
+         std::deque< std::function<void()> >  _queue;
+         bool                                 _stopping = false;
+   };
+
+} } // graphene::db
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/array.hpp>
+#include <fc/io/enum_type.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/safe.hpp>
+#include <fc/static_variant.hpp>
+#include <fc/time.hpp>
+#include <fc/uint128.hpp>
+#include <fc/variant.hpp>
+#include <fc/variant_object.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha1.hpp>
+#include <fc/crypto/sha224.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/sha512.hpp>
+
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+
+#include <array>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   namespace detail {
+
+      template<typename T, bool Reflected = fc::reflector<T>::is_defined::value && !fc::reflector<T>::is_enum::value>
+      struct type_describer;
+
+      template<typename... Ts>
+      struct type_list_describer;
+
+      template<>
+      struct type_list_describer<>
+      {
+         static void describe( std::string& ) {}
+      };
+
+      template<typename T, typename... Ts>
+      struct type_list_describer<T, Ts...>
+      {
+         static void describe( std::string& out )
+         {
+            type_describer<T>::describe( out );
+            if( sizeof...(Ts) > 0 )
+               out += ',';
+            type_list_describer<Ts...>::describe( out );
+         }
+      };
+
+      /**
+       *  Types without FC reflection (and enums).  Every name is spelled out here rather than taken from
+       *  typeid, which differs between compilers and standard libraries.  Arithmetic types are described
+       *  by their size, containers by their element types, so reflected types nested in them are covered.
+       *  Other types are described by their size only; specialize this for them to track their layout.
+       */
+      template<typename T>
+      struct unreflected_describer
+      {
+         static void describe( std::string& out )
+         {
+            describe( out, std::integral_constant<int, std::is_same<T,bool>::value ? 0
+                                                     : std::is_same<T,char>::value ? 1
+                                                     : std::is_integral<T>::value ? 2
+                                                     : std::is_floating_point<T>::value ? 3
+                                                     : std::is_enum<T>::value ? 4 : 5>() );
+         }
+
+      private:
+         static void describe( std::string& out, std::integral_constant<int,0> ) { out += "bool"; }
+         static void describe( std::string& out, std::integral_constant<int,1> ) { out += "char"; }
+         static void describe( std::string& out, std::integral_constant<int,2> )
+         {
+            out += std::is_signed<T>::value ? "int" : "uint";
+            out += std::to_string( sizeof(T) * 8 );
+         }
+         static void describe( std::string& out, std::integral_constant<int,3> )
+         {
+            out += "float";
+            out += std::to_string( sizeof(T) * 8 );
+         }
+         static void describe( std::string& out, std::integral_constant<int,4> ) { out += "enum"; }
+         static void describe( std::string& out, std::integral_constant<int,5> )
+         {
+            out += "opaque";
+            out += std::to_string( sizeof(T) );
+         }
+      };
+
+#define GRAPHENE_DB_DESCRIBE_TYPE_AS( TYPE, NAME ) \
+      template<> struct unreflected_describer< TYPE > \
+      { static void describe( std::string& out ) { out += NAME; } };
+
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( std::string,         "string" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::time_point,      "time_point" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::time_point_sec,  "time_point_sec" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::microseconds,    "microseconds" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::unsigned_int,    "varuint" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::signed_int,      "varint" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::uint128,         "uint128" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::ripemd160,       "ripemd160" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::sha1,            "sha1" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::sha224,          "sha224" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::sha256,          "sha256" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::sha512,          "sha512" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::ecc::public_key, "ecc_public_key" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::variant,         "variant" )
+      GRAPHENE_DB_DESCRIBE_TYPE_AS( fc::variant_object,  "variant_object" )
+
+#undef GRAPHENE_DB_DESCRIBE_TYPE_AS
+
+      template<typename T>
+      struct unreflected_describer< fc::optional<T> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "optional<";
+            type_describer<T>::describe( out );
+            out += '>';
+         }
+      };
+
+      template<typename A, typename B>
+      struct unreflected_describer< std::pair<A,B> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "pair<";
+            type_list_describer<A, B>::describe( out );
+            out += '>';
+         }
+      };
+
+      template<typename... Ts>
+      struct unreflected_describer< fc::static_variant<Ts...> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "static_variant<";
+            type_list_describer<Ts...>::describe( out );
+            out += '>';
+         }
+      };
+
+      /** containers are described by their element types, the comparators and allocators do not change the layout */
+#define GRAPHENE_DB_DESCRIBE_CONTAINER( TEMPLATE, NAME ) \
+      template<typename E, typename... Rest> struct unreflected_describer< TEMPLATE<E, Rest...> > \
+      { \
+         static void describe( std::string& out ) \
+         { \
+            out += NAME "<"; \
+            type_describer<E>::describe( out ); \
+            out += '>'; \
+         } \
+      };
+#define GRAPHENE_DB_DESCRIBE_MAP( TEMPLATE, NAME ) \
+      template<typename K, typename V, typename... Rest> struct unreflected_describer< TEMPLATE<K, V, Rest...> > \
+      { \
+         static void describe( std::string& out ) \
+         { \
+            out += NAME "<"; \
+            type_list_describer<K, V>::describe( out ); \
+            out += '>'; \
+         } \
+      };
+
+      GRAPHENE_DB_DESCRIBE_CONTAINER( std::vector,                "vector" )
+      GRAPHENE_DB_DESCRIBE_CONTAINER( std::deque,                 "deque" )
+      GRAPHENE_DB_DESCRIBE_CONTAINER( std::set,                   "set" )
+      GRAPHENE_DB_DESCRIBE_CONTAINER( boost::container::flat_set, "flat_set" )
+      GRAPHENE_DB_DESCRIBE_MAP( std::map,                         "map" )
+      GRAPHENE_DB_DESCRIBE_MAP( boost::container::flat_map,      "flat_map" )
+
+#undef GRAPHENE_DB_DESCRIBE_CONTAINER
+#undef GRAPHENE_DB_DESCRIBE_MAP
+
+      template<typename T, size_t N>
+      struct unreflected_describer< fc::array<T,N> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "array<";
+            type_describer<T>::describe( out );
+            out += ',' + std::to_string( N ) + '>';
+         }
+      };
+
+      template<typename T, size_t N>
+      struct unreflected_describer< std::array<T,N> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "array<";
+            type_describer<T>::describe( out );
+            out += ',' + std::to_string( N ) + '>';
+         }
+      };
+
+      template<typename T>
+      struct unreflected_describer< fc::safe<T> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "safe<";
+            type_describer<T>::describe( out );
+            out += '>';
+         }
+      };
+
+      /** serialized as the integer type, the enum only restricts the values */
+      template<typename IntType, typename EnumType>
+      struct unreflected_describer< fc::enum_type<IntType,EnumType> >
+      {
+         static void describe( std::string& out )
+         {
+            out += "enum_type<";
+            type_describer<IntType>::describe( out );
+            out += '>';
+         }
+      };
+
+      template<typename T>
+      struct type_describer<T, false>
+      {
+         static void describe( std::string& out ) { unreflected_describer<T>::describe( out ); }
+      };
+
+      /** reflected types are described by the names and descriptions of their members, including bases */
+      template<typename T>
+      struct type_describer<T, true>
+      {
+         struct member_visitor
+         {
+            member_visitor( std::string& o ):out(o){}
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* name )const
+            {
+               out += name;
+               out += ':';
+               type_describer<Member>::describe( out );
+               out += ';';
+            }
+
+            std::string& out;
+         };
+
+         static void describe( std::string& out )
+         {
+            out += '{';
+            fc::reflector<T>::visit( member_visitor( out ) );
+            out += '}';
+         }
+      };
+
+   } // detail
+
+   /**
+    *  @return a description of the serialized layout of T derived from its FC_REFLECT definition,
+    *  which changes whenever a reflected member is added, removed, renamed or changes type, also
+    *  within the containers, optionals and variants that hold it.  The description uses the same
+    *  names on every compiler and platform.
+    */
+   template<typename T>
+   std::string get_type_description()
+   {
+      std::string result;
+      detail::type_describer<T>::describe( result );
+      return result;
+   }
+
+} } // graphene::db
@@ -23,7 +23,10 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <algorithm>
 #include <deque>
+#include <unordered_set>
+#include <vector>
 #include <fc/exception/exception.hpp>
 
 namespace graphene { namespace db {
@@ -32,12 +35,118 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    * @class undo_pool
+    * @brief recycles the memory of the object copies and hash nodes held by undo states
+    *
+    * Blocks are carved out of large chunks and kept on a free list per size class when a state
+    * is undone, merged or discarded, to be handed out again to the next session.  Once the pool
+    * is warm, applying blocks and transactions does not go to the heap for undo bookkeeping.
+    * Requests larger than max_pooled_size are passed through to the heap.  Chunks are only
+    * released when the pool is destroyed.
+    */
+   class undo_pool : public object_allocator
+   {
+      public:
+         static const size_t granularity     = 16;
+         static const size_t max_pooled_size = 1024;
+         static const size_t chunk_size      = 64 * 1024;
+
+         undo_pool();
+         ~undo_pool();
+
+         virtual void* allocate( size_t size )override;
+         virtual void  deallocate( void* p, size_t size )override;
+
+         /** number of allocations requested from the pool */
+         uint64_t      allocations()const      { return _allocations; }
+         /** number of calls made to the heap, for chunks and for requests too large to pool */
+         uint64_t      heap_allocations()const { return _heap_allocations; }
+
+      private:
+         struct free_block { free_block* next; };
+
+         undo_pool( const undo_pool& ) = delete;
+         undo_pool& operator=( const undo_pool& ) = delete;
+
+         std::vector<free_block*> _free_lists;
+         std::vector<char*>       _chunks;
+         uint64_t                 _allocations = 0;
+         uint64_t                 _heap_allocations = 0;
+   };
+
+   /** std allocator adaptor that draws from an undo_pool */
+   template<typename T>
+   class undo_allocator
+   {
+      public:
+         typedef T         value_type;
+         typedef T*        pointer;
+         typedef const T*  const_pointer;
+         typedef T&        reference;
+         typedef const T&  const_reference;
+         typedef size_t    size_type;
+         typedef ptrdiff_t difference_type;
+         template<typename U> struct rebind { typedef undo_allocator<U> other; };
+
+         undo_allocator( undo_pool& pool ):_pool(&pool){}
+         template<typename U>
+         undo_allocator( const undo_allocator<U>& other ):_pool(other._pool){}
+
+         T*   allocate( size_t n )           { return static_cast<T*>( _pool->allocate( n * sizeof(T) ) ); }
+         void deallocate( T* p, size_t n )   { _pool->deallocate( p, n * sizeof(T) ); }
+
+         template<typename U>
+         bool operator == ( const undo_allocator<U>& other )const { return _pool == other._pool; }
+         template<typename U>
+         bool operator != ( const undo_allocator<U>& other )const { return _pool != other._pool; }
+
+      private:
+         template<typename U> friend class undo_allocator;
+         undo_pool* _pool;
+   };
+
+   /** destroys an object copied into an undo_pool and returns its memory to the pool */
+   struct undo_object_deleter
+   {
+      undo_pool* pool = nullptr;
+      size_t     size = 0;
+
+      void operator()( object* obj )const
+      {
+         obj->~object();
+         pool->deallocate( obj, size );
+      }
+   };
+   typedef unique_ptr<object, undo_object_deleter> undo_object_ptr;
+
+   /** old values of the fields of an object that were modified, see field_values */
+   typedef std::vector< char, undo_allocator<char> > field_diff;
+
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      typedef unordered_map< object_id_type, undo_object_ptr, std::hash<object_id_type>, std::equal_to<object_id_type>,
+                             undo_allocator< std::pair<const object_id_type, undo_object_ptr> > > object_map;
+      typedef unordered_map< object_id_type, object_id_type, std::hash<object_id_type>, std::equal_to<object_id_type>,
+                             undo_allocator< std::pair<const object_id_type, object_id_type> > >  id_map;
+      typedef unordered_map< object_id_type, field_diff, std::hash<object_id_type>, std::equal_to<object_id_type>,
+                             undo_allocator< std::pair<const object_id_type, field_diff> > >     diff_map;
+      typedef std::unordered_set< object_id_type, std::hash<object_id_type>, std::equal_to<object_id_type>,
+                                  undo_allocator<object_id_type> >                                id_set;
+
+      undo_state( undo_pool& pool )
+      :old_values( 0, object_map::hasher(), object_map::key_equal(), pool ),
+       old_index_next_ids( 0, id_map::hasher(), id_map::key_equal(), pool ),
+       new_ids( 0, id_set::hasher(), id_set::key_equal(), pool ),
+       removed( 0, object_map::hasher(), object_map::key_equal(), pool ),
+       old_fields( 0, diff_map::hasher(), diff_map::key_equal(), pool ){}
+
+      object_map old_values;
+      id_map     old_index_next_ids;
+      id_set     new_ids;
+      object_map removed;
+      /** like old_values, for objects of types which record field diffs */
+      diff_map   old_fields;
    };
 
 
@@ -108,6 +217,15 @@ namespace graphene { namespace db {
           * be removed if we undo.
           */
          void on_modify( const object& obj );
+         /**
+          * Used instead of on_modify() for types which record field diffs, see undo_field_diffs.  Only the first
+          * modification of an object in an undo state is recorded as a diff, a second one replaces the diff by a
+          * copy of the old object.
+          *
+          * @return the diff which the caller extends with the old values of the fields it changes,
+          * or nullptr if this modification does not need to be recorded
+          */
+         field_diff* on_modify_fields( const object& obj );
          /**
           * This should be called just before an object is removed.
           *
@@ -132,13 +250,32 @@ namespace graphene { namespace db {
 
          const undo_state& head()const;
 
+         typedef std::deque<undo_state>::const_iterator const_state_iterator;
+         /** the states of the sessions which have not been committed yet, oldest first */
+         const_state_iterator uncommitted_begin()const
+         {
+            return _stack.end() - std::min<size_t>( _unjournaled_states, _stack.size() );
+         }
+         const_state_iterator uncommitted_end()const { return _stack.end(); }
+         const undo_pool&  pool()const { return _pool; }
+
       private:
          void undo();
          void merge();
          void commit();
+         void on_untracked_change();
+         undo_object_ptr clone( const object& obj );
+         /** the value of obj before the changes recorded in diff */
+         undo_object_ptr old_value( const object& obj, const field_diff& diff );
+         void            restore_fields( object_id_type id, const field_diff& diff );
 
          uint32_t                _active_sessions = 0;
+         /** number of states at the top of the stack that have not been committed and written to the object journal */
+         uint32_t                _unjournaled_states = 0;
          bool                    _disabled = true;
+         bool                    _popping_commit = false;
+         /** declared before _stack, which returns its memory to the pool when destroyed */
+         undo_pool               _pool;
          std::deque<undo_state>  _stack;
          object_database&        _db;
          size_t                  _max_size = 256;
@@ -29,6 +29,9 @@ namespace graphene { namespace db {
    void base_primary_index::save_undo( const object& obj )
    { _db.save_undo( obj ); }
 
+   field_diff* base_primary_index::save_undo_fields( const object& obj )
+   { return _db.save_undo_fields( obj ); }
+
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
@@ -24,11 +24,61 @@
 #include <graphene/db/object_database.hpp>
 
 #include <fc/io/raw.hpp>
+#include <fc/time.hpp>
 #include <fc/container/flat.hpp>
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace db {
+
+/**
+ * The changes of one committed (or popped) undo state, as appended to the object journal
+ */
+struct object_journal_record
+{
+   vector< std::pair< object_id_type, vector<char> > > upserted;
+   vector< object_id_type >                            removed;
+   vector< object_id_type >                            next_ids;
+};
+
+} }
+FC_REFLECT( graphene::db::object_journal_record, (upserted)(removed)(next_ids) )
+
 namespace graphene { namespace db {
 
+namespace {
+   /** @return the number of bytes appended */
+   uint64_t append_journal_record( std::FILE* journal, const object_journal_record& record )
+   {
+      const vector<char> data = fc::raw::pack( fc::raw::pack( record ) );
+      FC_ASSERT( std::fwrite( data.data(), 1, data.size(), journal ) == data.size(), "Unable to write the object journal" );
+      return data.size();
+   }
+
+   /** writes the buffered records and waits until they are on disk */
+   void sync_journal( std::FILE* journal )
+   {
+      FC_ASSERT( std::fflush( journal ) == 0, "Unable to write the object journal" );
+#if defined(_WIN32)
+      FC_ASSERT( _commit( _fileno( journal ) ) == 0, "Unable to sync the object journal" );
+#elif defined(__APPLE__)
+      FC_ASSERT( fsync( fileno( journal ) ) == 0, "Unable to sync the object journal" );
+#else
+      FC_ASSERT( fdatasync( fileno( journal ) ) == 0, "Unable to sync the object journal" );
+#endif
+   }
+}
+
 object_database::object_database()
 :_undo_db(*this)
 {
@@ -36,10 +86,14 @@ object_database::object_database()
    _undo_db.enable();
 }
 
-object_database::~object_database(){}
+object_database::~object_database()
+{
+   close_journal();
+}
 
 void object_database::close()
 {
+   close_journal();
 }
 
 const object* object_database::find_object( object_id_type id )const
@@ -71,6 +125,7 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
 void object_database::flush()
 {
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
+   close_journal();
    fc::create_directories( _data_dir / "object_database.tmp" / "lock" );
    for( uint32_t space = 0; space < _index.size(); ++space )
    {
@@ -80,11 +135,48 @@ void object_database::flush()
          if( _index[space][type] )
             _index[space][type]->save( _data_dir / "object_database.tmp" / fc::to_string(space)/fc::to_string(type) );
    }
+   {
+      // readers of the flushed files check it to notice that the directory has been replaced
+      std::ofstream out( ( _data_dir / "object_database.tmp" / "flush_id" ).generic_string(),
+                         std::ofstream::out | std::ofstream::trunc );
+      out << std::max<uint64_t>( 1, fc::time_point::now().time_since_epoch().count() );
+      FC_ASSERT( out, "Unable to write the flush id" );
+   }
    fc::remove_all( _data_dir / "object_database.tmp" / "lock" );
    if( fc::exists( _data_dir / "object_database" ) )
       fc::rename( _data_dir / "object_database", _data_dir / "object_database.old" );
    fc::rename( _data_dir / "object_database.tmp", _data_dir / "object_database" );
    fc::remove_all( _data_dir / "object_database.old" );
+
+   // the new directory does not contain a journal, start a fresh one on top of it
+   _journal_stale = false;
+   if( _journal_enabled )
+      open_journal();
+}
+
+uint64_t object_database::read_flush_id( const fc::path& data_dir )
+{
+   std::ifstream in( flush_id_path( data_dir ).generic_string() );
+   uint64_t result = 0;
+   if( !( in >> result ) )
+      return 0;
+   return result;
+}
+
+void object_database::enable_journal( uint64_t compact_size )
+{
+   _journal_enabled = true;
+   _journal_compact_size = compact_size;
+}
+
+void object_database::persist()
+{
+   if( _journal_enabled && !_journal_stale && _journal != nullptr )
+   {
+      sync_journal( _journal );
+      return;
+   }
+   flush();
 }
 
 void object_database::wipe(const fc::path& data_dir)
@@ -104,15 +196,85 @@ void object_database::open(const fc::path& data_dir)
        return;
    }
    ilog("Opening object database from ${d} ...", ("d", data_dir));
+   _journal_stale = false;
+   _state_hash_valid = false;
+
+   // indexes are independent of each other, so they are loaded in parallel
+   vector< std::pair<uint32_t,uint32_t> > to_open;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+            to_open.emplace_back( space, type );
+   get_thread_pool().parallel_for( to_open.size(), [&]( size_t i ) {
+      const uint32_t space = to_open[i].first;
+      const uint32_t type  = to_open[i].second;
+      _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+   });
+
+   // the journal is replayed even if it is disabled now, it holds the newest state
+   if( fc::exists( journal_path() ) )
+      replay_journal();
+   if( _journal_enabled )
+   {
+      if( fc::exists( journal_path() ) && fc::file_size( journal_path() ) > _journal_compact_size )
+      {
+         ilog( "Compacting object journal..." );
+         flush();
+      }
+      else
+         open_journal();
+   }
    ilog( "Done opening object database." );
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
 
+thread_pool& object_database::get_thread_pool()
+{
+   if( !_thread_pool )
+      _thread_pool.reset( new thread_pool() );
+   return *_thread_pool;
+}
+
+fc::sha256 object_database::state_digest()
+{ try {
+   if( !_state_hash_valid )
+   {
+      vector< std::pair<uint32_t,uint32_t> > to_hash;
+      index_hash_table hashes( _index.size() );
+      for( uint32_t space = 0; space < _index.size(); ++space )
+      {
+         hashes[space].resize( _index[space].size() );
+         for( uint32_t type = 0; type < _index[space].size(); ++type )
+            if( _index[space][type] )
+               to_hash.emplace_back( space, type );
+      }
+      get_thread_pool().parallel_for( to_hash.size(), [&]( size_t i ) {
+         const uint32_t space = to_hash[i].first;
+         const uint32_t type  = to_hash[i].second;
+         hashes[space][type] = _index[space][type]->hash();
+      });
+
+      // take out the changes of the active sessions, which have not been committed
+      FC_ASSERT( hash_changes( _undo_db.uncommitted_begin(), _undo_db.uncommitted_end(), true, hashes ),
+                 "Unable to determine the state before the active undo sessions" );
+      _index_hashes = std::move( hashes );
+      _state_hash_valid = true;
+   }
+
+   // the sums do not depend on the order objects were hashed in, and indexes are combined in a fixed order
+   fc::sha256::encoder enc;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+         if( _index[space][type] )
+         {
+            fc::raw::pack( enc, uint8_t(space) );
+            fc::raw::pack( enc, uint8_t(type) );
+            fc::raw::pack( enc, _index_hashes[space][type] );
+         }
+   return enc.result();
+} FC_CAPTURE_AND_RETHROW() }
+
 void object_database::pop_undo()
 { try {
    _undo_db.pop_commit();
@@ -123,6 +285,11 @@ void object_database::save_undo( const object& obj )
    _undo_db.on_modify( obj );
 }
 
+field_diff* object_database::save_undo_fields( const object& obj )
+{
+   return _undo_db.on_modify_fields( obj );
+}
+
 void object_database::save_undo_add( const object& obj )
 {
    _undo_db.on_create( obj );
@@ -133,4 +300,233 @@ void object_database::save_undo_remove(const object& obj)
    _undo_db.on_remove( obj );
 }
 
+void object_database::open_journal()
+{
+   close_journal();
+   fc::create_directories( _data_dir / "object_database" );
+   _journal = std::fopen( journal_path().generic_string().c_str(), "ab" );
+   FC_ASSERT( _journal != nullptr, "Unable to open object journal", ("path", journal_path()) );
+   _journal_size = fc::file_size( journal_path() );
+}
+
+void object_database::close_journal()
+{
+   if( _journal == nullptr ) return;
+   std::fclose( _journal );
+   _journal = nullptr;
+}
+
+void object_database::invalidate_journal()
+{
+   // Until the next flush() the journal can not reproduce the current state.  Remove it, so
+   // that after a crash the last flush is loaded and the blocks after it are replayed.
+   wlog( "Object state changed outside of an undo session, disabling the object journal until the next flush" );
+   _journal_stale = true;
+   close_journal();
+   fc::remove_all( journal_path() );
+}
+
+void object_database::journal_commit( const undo_state& state )
+{
+   if( _journal_stale || _journal == nullptr ) return;
+
+   object_journal_record record;
+   record.upserted.reserve( state.old_values.size() + state.old_fields.size() + state.new_ids.size() );
+   // Objects which have been removed by a later state that is journaled in the same commit
+   // can not be found anymore, that later state records their removal.
+   for( const auto& item : state.old_values )
+   {
+      const object* obj = find_object( item.first );
+      if( obj != nullptr )
+         record.upserted.emplace_back( item.first, obj->pack() );
+   }
+   for( const auto& item : state.old_fields )
+   {
+      const object* obj = find_object( item.first );
+      if( obj != nullptr )
+         record.upserted.emplace_back( item.first, obj->pack() );
+   }
+   for( const auto& id : state.new_ids )
+   {
+      const object* obj = find_object( id );
+      if( obj != nullptr )
+         record.upserted.emplace_back( id, obj->pack() );
+   }
+   for( const auto& item : state.removed )
+      record.removed.push_back( item.first );
+   for( const auto& item : state.old_index_next_ids )
+      record.next_ids.push_back( get_index( item.first.space(), item.first.type() ).get_next_id() );
+
+   _journal_size += append_journal_record( _journal, record );
+}
+
+void object_database::journal_sync()
+{
+   if( _journal_stale || _journal == nullptr ) return;
+   // the committed states are all in memory, so a flush can take the place of the journal
+   if( _journal_size > _journal_compact_size )
+   {
+      ilog( "Compacting object journal of ${n} bytes...", ("n", _journal_size) );
+      flush();
+      return;
+   }
+   sync_journal( _journal );
+}
+
+void object_database::journal_pop( const undo_state& state )
+{
+   if( _journal_stale || _journal == nullptr ) return;
+
+   object_journal_record record;
+   record.upserted.reserve( state.old_values.size() + state.old_fields.size() + state.removed.size() );
+   for( const auto& item : state.old_values )
+      record.upserted.emplace_back( item.first, item.second->pack() );
+   for( const auto& item : state.old_fields )
+   {
+      auto old = get_object( item.first ).clone();
+      get_index( item.first.space(), item.first.type() ).apply_field_diff( *old, item.second.data(), item.second.size() );
+      record.upserted.emplace_back( item.first, old->pack() );
+   }
+   for( const auto& item : state.removed )
+      record.upserted.emplace_back( item.first, item.second->pack() );
+   for( const auto& id : state.new_ids )
+      record.removed.push_back( id );
+   for( const auto& item : state.old_index_next_ids )
+      record.next_ids.push_back( item.second );
+
+   // the state is only undone after this, so the journal is not compacted here
+   _journal_size += append_journal_record( _journal, record );
+   sync_journal( _journal );
+}
+
+template<typename StateIterator>
+bool object_database::hash_changes( StateIterator first, StateIterator last, bool revert, index_hash_table& hashes )const
+{
+   // Walk the states from the newest to the oldest, undoing them on the side, to find the value
+   // each touched object had before the first of them, or nullptr if it did not exist then.
+   std::unordered_map< object_id_type, const object* > before;
+   vector< unique_ptr<object> > copies;
+   while( last != first )
+   {
+      const undo_state& state = *--last;
+      for( const auto& item : state.old_values )
+         before[item.first] = item.second.get();
+      for( const auto& item : state.removed )
+         before[item.first] = item.second.get();
+      for( const auto& id : state.new_ids )
+         before[id] = nullptr;
+      for( const auto& item : state.old_fields )
+      {
+         auto itr = before.find( item.first );
+         const object* newer = itr != before.end() ? itr->second : find_object( item.first );
+         if( newer == nullptr )
+            return false;
+         copies.push_back( newer->clone() );
+         get_index( item.first.space(), item.first.type() ).apply_field_diff( *copies.back(), item.second.data(), item.second.size() );
+         before[item.first] = copies.back().get();
+      }
+   }
+
+   vector<char> buffer;
+   for( const auto& item : before )
+   {
+      fc::uint128 old_hash;
+      fc::uint128 new_hash;
+      if( item.second != nullptr )
+         old_hash = item.second->hash( buffer );
+      if( const object* obj = find_object( item.first ) )
+         new_hash = obj->hash( buffer );
+      fc::uint128& index_hash = hashes[item.first.space()][item.first.type()];
+      if( revert )
+      {
+         index_hash += old_hash;
+         index_hash -= new_hash;
+      }
+      else
+      {
+         index_hash += new_hash;
+         index_hash -= old_hash;
+      }
+   }
+   return true;
+}
+
+void object_database::state_hash_commit( undo_database::const_state_iterator first, undo_database::const_state_iterator last )
+{
+   if( !_state_hash_valid ) return;
+   try {
+      _state_hash_valid = hash_changes( first, last, false, _index_hashes );
+   } catch( const fc::exception& e ) {
+      wlog( "Unable to update the state hash: ${e}", ("e",e.to_detail_string()) );
+      _state_hash_valid = false;
+   }
+}
+
+void object_database::state_hash_pop( const undo_state& state )
+{
+   if( !_state_hash_valid ) return;
+   try {
+      _state_hash_valid = hash_changes( &state, &state + 1, true, _index_hashes );
+   } catch( const fc::exception& e ) {
+      wlog( "Unable to update the state hash: ${e}", ("e",e.to_detail_string()) );
+      _state_hash_valid = false;
+   }
+}
+
+void object_database::replay_journal()
+{ try {
+   const fc::path path = journal_path();
+   const uint64_t size = fc::file_size( path );
+   uint64_t valid_size = 0;
+   uint32_t count = 0;
+
+   // objects of indexes which are not registered anymore (e.g. a disabled plugin) are skipped
+   auto find_index = [this]( object_id_type id ) -> index* {
+      if( _index.size() <= id.space() || _index[id.space()].size() <= id.type() )
+         return nullptr;
+      return _index[id.space()][id.type()].get();
+   };
+
+   if( size > 0 )
+   {
+      fc::file_mapping fm( path.generic_string().c_str(), fc::read_only );
+      fc::mapped_region mr( fm, fc::read_only, 0, size );
+      fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+      while( ds.remaining() > 0 )
+      {
+         object_journal_record record;
+         try
+         {
+            vector<char> data;
+            fc::raw::unpack( ds, data );
+            record = fc::raw::unpack<object_journal_record>( data );
+         }
+         catch( const fc::exception& )
+         {
+            break; // incomplete record at the end of the journal, e.g. after a crash
+         }
+
+         for( const auto& id : record.removed )
+            if( index* idx = find_index( id ) )
+               idx->discard( id );
+         for( const auto& item : record.upserted )
+            if( index* idx = find_index( item.first ) )
+               idx->restore( item.second );
+         for( const auto& id : record.next_ids )
+            if( index* idx = find_index( id ) )
+               idx->set_next_id( id );
+
+         valid_size = ds.tellp();
+         ++count;
+      }
+   }
+
+   if( valid_size < size )
+   {
+      wlog( "Discarding ${n} bytes at the end of the object journal", ("n", size - valid_size) );
+      fc::resize_file( path, valid_size );
+   }
+   ilog( "Replayed ${n} object journal records", ("n", count) );
+} FC_CAPTURE_AND_RETHROW() }
+
 } } // namespace graphene::db
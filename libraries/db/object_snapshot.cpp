@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/object_snapshot.hpp>
+#include <graphene/db/object_database.hpp>
+
+#include <cstring>
+
+namespace graphene { namespace db {
+
+object_snapshot::mapped_index::mapped_index( const fc::path& file )
+{ try {
+   const uint64_t file_size = fc::file_size( file );
+   FC_ASSERT( file_size >= fc::raw::pack_size( _header ), "Index file is truncated" );
+
+   _file.reset( new fc::file_mapping( file.generic_string().c_str(), fc::read_only ) );
+   _region.reset( new fc::mapped_region( *_file, fc::read_only, 0, file_size ) );
+   _data = (const char*)_region->get_address();
+
+   fc::datastream<const char*> ds( _data, file_size );
+   fc::raw::unpack( ds, _header );
+   FC_ASSERT( _header.format == index_file_header::current_format, "Unsupported index file format",
+              ("format",_header.format) );
+   FC_ASSERT( _header.table_pos >= ds.tellp() && _header.table_pos <= file_size, "Index file is truncated" );
+
+   const uint64_t table_size = file_size - _header.table_pos;
+   FC_ASSERT( index_file_header::checksum( _data + _header.table_pos, table_size ) == _header.table_checksum,
+              "Index file offset table is corrupt" );
+
+   // index_file_table starts with the packed offsets vector: its length, then the raw values
+   fc::datastream<const char*> table_ds( _data + _header.table_pos, table_size );
+   fc::unsigned_int offset_count;
+   fc::raw::unpack( table_ds, offset_count );
+   FC_ASSERT( offset_count.value == _header.object_count + 1
+              && table_ds.remaining() >= offset_count.value * sizeof(uint64_t),
+              "Index file offset table is inconsistent" );
+   _offsets = _data + _header.table_pos + table_ds.tellp();
+
+   FC_ASSERT( offset( 0 ) == ds.tellp() && offset( size() ) == _header.table_pos,
+              "Index file offset table is inconsistent" );
+   for( uint64_t n = 0; n < size(); ++n )
+      FC_ASSERT( offset( n ) + sizeof(uint64_t) <= offset( n + 1 ), "Index file offset table is inconsistent", ("object",n) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+uint64_t object_snapshot::mapped_index::offset( uint64_t n )const
+{
+   // the table is not aligned within the file
+   uint64_t result;
+   memcpy( &result, _offsets + n * sizeof(uint64_t), sizeof(result) );
+   return result;
+}
+
+object_id_type object_snapshot::mapped_index::id_at( uint64_t n )const
+{
+   // every object serializes its id first
+   object_id_type result;
+   memcpy( &result.number, object_data( n ), sizeof(result.number) );
+   return result;
+}
+
+uint64_t object_snapshot::mapped_index::position_of( object_id_type id )const
+{
+   const uint64_t count = size();
+   // objects are saved in ID order, which for densely allocated types puts each at its instance
+   if( id.instance() < count && id_at( id.instance() ) == id )
+      return id.instance();
+
+   uint64_t low = 0, high = count;
+   while( low < high )
+   {
+      const uint64_t mid = low + ( high - low ) / 2;
+      if( id_at( mid ) < id )
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   if( low < count && id_at( low ) == id )
+      return low;
+   return count;
+}
+
+object_snapshot::object_snapshot() {}
+
+object_snapshot::~object_snapshot() {}
+
+void object_snapshot::open( const fc::path& data_dir )
+{ try {
+   close();
+   const fc::path root = data_dir / "object_database";
+   FC_ASSERT( fc::exists( root ), "No object database found" );
+   _flush_id = object_database::read_flush_id( data_dir );
+
+   _indexes.resize( 255 );
+   for( uint32_t space = 0; space < 255; ++space )
+   {
+      const fc::path space_dir = root / fc::to_string(space);
+      if( !fc::exists( space_dir ) ) continue;
+      _indexes[space].resize( 255 );
+      for( uint32_t type = 0; type < 255; ++type )
+      {
+         const fc::path file = space_dir / fc::to_string(type);
+         if( fc::exists( file ) )
+            _indexes[space][type].reset( new mapped_index( file ) );
+      }
+   }
+   // files opened after the directory was replaced belong to a different flush
+   if( object_database::read_flush_id( data_dir ) != _flush_id )
+   {
+      close();
+      FC_THROW( "The object database was flushed again while it was being opened" );
+   }
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+void object_snapshot::close()
+{
+   _indexes.clear();
+   _flush_id = 0;
+}
+
+const object_snapshot::mapped_index* object_snapshot::get_index( uint8_t space_id, uint8_t type_id )const
+{
+   if( _indexes.size() <= space_id || _indexes[space_id].size() <= type_id )
+      return nullptr;
+   return _indexes[space_id][type_id].get();
+}
+
+bool object_snapshot::find_serialized( object_id_type id, const char*& data, size_t& size )const
+{
+   const mapped_index* idx = get_index( id.space(), id.type() );
+   if( idx == nullptr ) return false;
+   const uint64_t pos = idx->position_of( id );
+   if( pos == idx->size() ) return false;
+   data = idx->object_data( pos );
+   size = idx->object_size( pos );
+   return true;
+}
+
+} } // graphene::db
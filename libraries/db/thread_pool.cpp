@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace graphene { namespace db {
+
+thread_pool::thread_pool( uint32_t thread_count )
+{
+   if( thread_count == 0 )
+      thread_count = std::max( 1u, std::thread::hardware_concurrency() );
+   _threads.reserve( thread_count );
+   for( uint32_t i = 0; i < thread_count; ++i )
+      _threads.emplace_back( [this](){ worker_loop(); } );
+}
+
+thread_pool::~thread_pool()
+{
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _stopping = true;
+   }
+   _work_cv.notify_all();
+   for( auto& t : _threads )
+      t.join();
+}
+
+void thread_pool::worker_loop()
+{
+   while( true )
+   {
+      std::function<void()> task;
+      {
+         std::unique_lock<std::mutex> lock( _mutex );
+         _work_cv.wait( lock, [this](){ return _stopping || !_queue.empty(); } );
+         if( _queue.empty() )
+            return;
+         task = std::move( _queue.front() );
+         _queue.pop_front();
+      }
+      task();
+   }
+}
+
+void thread_pool::parallel_for( size_t count, const std::function<void(size_t)>& f )
+{
+   if( count == 0 )
+      return;
+   if( count == 1 || _threads.empty() )
+   {
+      for( size_t i = 0; i < count; ++i )
+         f( i );
+      return;
+   }
+
+   std::atomic<size_t>      next( 0 );
+   std::exception_ptr       error;
+   std::condition_variable  done_cv;
+   size_t                   running = std::min<size_t>( count, _threads.size() ); // guarded by _mutex
+
+   auto work = [&]() {
+      for( size_t i = next++; i < count; i = next++ )
+      {
+         try
+         {
+            f( i );
+         }
+         catch( ... )
+         {
+            std::lock_guard<std::mutex> lock( _mutex );
+            if( !error )
+               error = std::current_exception();
+            next = count;
+         }
+      }
+      std::lock_guard<std::mutex> lock( _mutex );
+      if( --running == 0 )
+         done_cv.notify_all();
+   };
+
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      for( size_t i = 0; i < running; ++i )
+         _queue.push_back( work );
+   }
+   _work_cv.notify_all();
+
+   std::unique_lock<std::mutex> lock( _mutex );
+   done_cv.wait( lock, [&](){ return running == 0; } );
+   lock.unlock();
+
+   if( error )
+      std::rethrow_exception( error );
+}
+
+} } // graphene::db
@@ -25,8 +25,61 @@
 #include <graphene/db/undo_database.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace db {
 
+undo_pool::undo_pool()
+:_free_lists( max_pooled_size / granularity + 1, nullptr ){}
+
+undo_pool::~undo_pool()
+{
+   for( char* chunk : _chunks )
+      ::operator delete( chunk );
+}
+
+void* undo_pool::allocate( size_t size )
+{
+   ++_allocations;
+   if( size > max_pooled_size )
+   {
+      ++_heap_allocations;
+      return ::operator new( size );
+   }
+   const size_t size_class = ( std::max<size_t>( size, 1 ) + granularity - 1 ) / granularity;
+   free_block*& head = _free_lists[size_class];
+   if( head == nullptr )
+   {
+      // carve a new chunk into blocks of this class
+      ++_heap_allocations;
+      const size_t block_size = size_class * granularity;
+      char* chunk = static_cast<char*>( ::operator new( chunk_size ) );
+      _chunks.push_back( chunk );
+      for( size_t pos = 0; pos + block_size <= chunk_size; pos += block_size )
+      {
+         free_block* block = reinterpret_cast<free_block*>( chunk + pos );
+         block->next = head;
+         head = block;
+      }
+   }
+   free_block* block = head;
+   head = block->next;
+   return block;
+}
+
+void undo_pool::deallocate( void* p, size_t size )
+{
+   if( size > max_pooled_size )
+   {
+      ::operator delete( p );
+      return;
+   }
+   const size_t size_class = ( std::max<size_t>( size, 1 ) + granularity - 1 ) / granularity;
+   free_block* block = static_cast<free_block*>( p );
+   block->next = _free_lists[size_class];
+   _free_lists[size_class] = block;
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -37,19 +90,63 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
    if( force_enable ) 
       _disabled = false;
 
-   while( size() > max_size() )
+   // only states which no session refers to any more count against max_size, a database may keep
+   // any number of nested sessions open, e.g. one per pending transaction
+   while( size() > _active_sessions && size() - _active_sessions > max_size() )
       _stack.pop_front();
 
-   _stack.emplace_back();
+   _stack.emplace_back( _pool );
    ++_active_sessions;
+   ++_unjournaled_states;
    return session(*this, disable_on_exit );
 }
+void undo_database::on_untracked_change()
+{
+   // Changes made outside of any session (e.g. with undo disabled while replaying or
+   // initializing genesis) can never be committed, so the journal and the state hashes no longer
+   // describe the state.
+   if( _active_sessions == 0 && !_popping_commit )
+      _db.on_untracked_change();
+}
+undo_object_ptr undo_database::clone( const object& obj )
+{
+   // records the size of the copy, which is needed to return it to the pool
+   struct sized_allocator : public object_allocator
+   {
+      sized_allocator( undo_pool& p ):pool(p){}
+      virtual void* allocate( size_t s )override             { size = s; return pool.allocate( s ); }
+      virtual void  deallocate( void* p, size_t s )override  { pool.deallocate( p, s ); }
+      undo_pool& pool;
+      size_t     size = 0;
+   } alloc( _pool );
+
+   object* copy = obj.clone( alloc );
+   undo_object_deleter deleter;
+   deleter.pool = &_pool;
+   deleter.size = alloc.size;
+   return undo_object_ptr( copy, deleter );
+}
+
+undo_object_ptr undo_database::old_value( const object& obj, const field_diff& diff )
+{
+   undo_object_ptr result = clone( obj );
+   _db.get_index( obj.id.space(), obj.id.type() ).apply_field_diff( *result, diff.data(), diff.size() );
+   return result;
+}
+
+void undo_database::restore_fields( object_id_type id, const field_diff& diff )
+{
+   const index& idx = _db.get_index( id.space(), id.type() );
+   _db.modify( _db.get_object( id ), [&]( object& obj ){ idx.apply_field_diff( obj, diff.data(), diff.size() ); } );
+}
+
 void undo_database::on_create( const object& obj )
 {
+   on_untracked_change();
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( _pool );
    auto& state = _stack.back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
    auto itr = state.old_index_next_ids.find( index_id );
@@ -59,23 +156,48 @@ void undo_database::on_create( const object& obj )
 }
 void undo_database::on_modify( const object& obj )
 {
+   on_untracked_change();
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( _pool );
    auto& state = _stack.back();
    if( state.new_ids.find(obj.id) != state.new_ids.end() )
       return;
    auto itr =  state.old_values.find(obj.id);
    if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   state.old_values[obj.id] = clone( obj );
+}
+field_diff* undo_database::on_modify_fields( const object& obj )
+{
+   on_untracked_change();
+   if( _disabled ) return nullptr;
+
+   if( _stack.empty() )
+      _stack.emplace_back( _pool );
+   auto& state = _stack.back();
+   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+      return nullptr;
+   if( state.old_values.find(obj.id) != state.old_values.end() )
+      return nullptr;
+   auto fields = state.old_fields.find(obj.id);
+   if( fields != state.old_fields.end() )
+   {
+      // modified again in this state, the old value is kept in full from now on so that further
+      // modifications of the object neither capture nor compare its fields
+      state.old_values[obj.id] = old_value( obj, fields->second );
+      state.old_fields.erase( fields );
+      return nullptr;
+   }
+   return &state.old_fields.emplace( obj.id, field_diff( _pool ) ).first->second;
 }
 void undo_database::on_remove( const object& obj )
 {
+   on_untracked_change();
    if( _disabled ) return;
 
    if( _stack.empty() )
-      _stack.emplace_back();
+      _stack.emplace_back( _pool );
    undo_state& state = _stack.back();
    if( state.new_ids.count(obj.id) )
    {
@@ -88,8 +210,15 @@ void undo_database::on_remove( const object& obj )
       state.old_values.erase(obj.id);
       return;
    }
+   auto fields = state.old_fields.find(obj.id);
+   if( fields != state.old_fields.end() )
+   {
+      state.removed[obj.id] = old_value( obj, fields->second );
+      state.old_fields.erase( fields );
+      return;
+   }
    if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed[obj.id] = clone( obj );
 }
 
 void undo_database::undo()
@@ -104,6 +233,9 @@ void undo_database::undo()
       _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
    }
 
+   for( auto& item : state.old_fields )
+      restore_fields( item.first, item.second );
+
    for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
    {
       _db.remove( _db.get_object(*ritr) );
@@ -120,6 +252,8 @@ void undo_database::undo()
    _stack.pop_back();
    enable();
    --_active_sessions;
+   if( _unjournaled_states > 0 )
+      --_unjournaled_states;
 } FC_CAPTURE_AND_RETHROW() }
 
 void undo_database::merge()
@@ -129,6 +263,9 @@ void undo_database::merge()
    {
       _stack.pop_back();
       --_active_sessions;
+      _unjournaled_states = 0;
+      // the changes can no longer be undone, but they were never committed either
+      _db.on_untracked_change();
       return;
    }
    FC_ASSERT( _stack.size() >=2 );
@@ -190,12 +327,39 @@ void undo_database::merge()
          // upd(was=X) + upd(was=Y) -> upd(was=X), type A
          continue;
       }
+      auto fields = prev_state.old_fields.find(obj.second->id);
+      if( fields != prev_state.old_fields.end() )
+      {
+         // upd(was=X) + upd(was=Y) -> upd(was=X), where X is Y with the fields recorded in A restored
+         const object_id_type id = obj.second->id;
+         _db.get_index( id.space(), id.type() ).apply_field_diff( *obj.second, fields->second.data(), fields->second.size() );
+         prev_state.old_fields.erase( fields );
+         prev_state.old_values[id] = std::move(obj.second);
+         continue;
+      }
       // del+upd -> N/A
       assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
       // nop+upd(was=Y) -> upd(was=Y), type B
       prev_state.old_values[obj.second->id] = std::move(obj.second);
    }
 
+   // *+upd recorded as field diffs, the same cases as above
+   for( auto& item : state.old_fields )
+   {
+      if( prev_state.new_ids.find(item.first) != prev_state.new_ids.end()
+          || prev_state.old_values.find(item.first) != prev_state.old_values.end() )
+         continue;
+      auto fields = prev_state.old_fields.find(item.first);
+      if( fields != prev_state.old_fields.end() )
+      {
+         // upd(was=X) + upd(was=Y) -> upd(was=X), where the fields changed only in B were Y
+         merge_field_diffs( fields->second, item.second.data(), item.second.size() );
+         continue;
+      }
+      assert( prev_state.removed.find(item.first) == prev_state.removed.end() );
+      prev_state.old_fields.emplace( item.first, std::move(item.second) );
+   }
+
    // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
    for( auto id : state.new_ids )
       prev_state.new_ids.insert(id);
@@ -234,6 +398,16 @@ void undo_database::merge()
          prev_state.old_values.erase(obj.second->id);
          continue;
       }
+      auto fields = prev_state.old_fields.find(obj.second->id);
+      if( fields != prev_state.old_fields.end() )
+      {
+         // upd(was=X) + del(was=Y) -> del(was=X), where X is Y with the fields recorded in A restored
+         const object_id_type id = obj.second->id;
+         _db.get_index( id.space(), id.type() ).apply_field_diff( *obj.second, fields->second.data(), fields->second.size() );
+         prev_state.removed[id] = std::move(obj.second);
+         prev_state.old_fields.erase( fields );
+         continue;
+      }
       // del + del -> N/A
       assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
       // nop + del(was=Y) -> del(was=Y)
@@ -241,11 +415,28 @@ void undo_database::merge()
    }
    _stack.pop_back();
    --_active_sessions;
+   if( _unjournaled_states == 1 )
+   {
+      // merged into a state which has already been journaled
+      _unjournaled_states = 0;
+      _db.on_untracked_change();
+   }
+   else if( _unjournaled_states > 0 )
+      --_unjournaled_states;
 }
 void undo_database::commit()
 {
    FC_ASSERT( _active_sessions > 0 );
    --_active_sessions;
+   if( _active_sessions == 0 )
+   {
+      const auto first = uncommitted_begin();
+      for( auto itr = first; itr != _stack.end(); ++itr )
+         _db.journal_commit( *itr );
+      _db.state_hash_commit( first, _stack.end() );
+      _unjournaled_states = 0;
+      _db.journal_sync();
+   }
 }
 
 void undo_database::pop_commit()
@@ -254,14 +445,20 @@ void undo_database::pop_commit()
    FC_ASSERT( !_stack.empty() );
 
    disable();
+   _popping_commit = true;
    try {
       auto& state = _stack.back();
+      _db.journal_pop( state );
+      _db.state_hash_pop( state );
 
       for( auto& item : state.old_values )
       {
          _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
       }
 
+      for( auto& item : state.old_fields )
+         restore_fields( item.first, item.second );
+
       for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
       {
          _db.remove( _db.get_object(*ritr) );
@@ -280,9 +477,11 @@ void undo_database::pop_commit()
    catch ( const fc::exception& e )
    {
       elog( "error popping commit ${e}", ("e", e.to_detail_string() )  );
+      _popping_commit = false;
       enable();
       throw;
    }
+   _popping_commit = false;
    enable();
 }
 const undo_state& undo_database::head()const
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/market_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+/**
+ * Matching throughput in the market of a bitasset with thousands of well collateralized call orders:
+ * every order pair is a resting ask selling USD below the max short squeeze price and a bid filling it,
+ * so each of the four check_call_orders in apply_order finds nothing to call.  Also reports the cost of
+ * deciding that, call_orders_need_check, on its own.
+ */
+BOOST_FIXTURE_TEST_CASE( margin_call_check_bench, database_fixture )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t call_count  = 5000;
+      const uint32_t order_pairs = 20000;
+#else
+      const uint32_t call_count  = 500;
+      const uint32_t order_pairs = 2000;
+#endif
+
+      ACTORS( (seller)(buyer)(feedproducer) );
+      const auto& bitusd = create_bitasset( "USDBIT", feedproducer_id );
+      const asset_id_type usd_id = bitusd.id;
+      update_feed_producers( bitusd, {feedproducer_id} );
+
+      price_feed feed;
+      feed.maintenance_collateral_ratio = 1750;
+      feed.maximum_short_squeeze_ratio = 1100;
+      feed.settlement_price = bitusd.amount( 1 ) / asset( 5 );
+      publish_feed( bitusd, feedproducer, feed );
+
+      for( uint32_t i = 0; i < call_count; ++i )
+      {
+         const account_object& borrower = create_account( "borrower" + fc::to_string( i ) );
+         transfer( committee_account, borrower.id, asset( 20000 ) );
+         // between 200% and 300% collateral, well above the maintenance ratio
+         borrow( borrower, bitusd.amount( 1000 ), asset( 10000 + 5 * ( i % 1000 ) ) );
+      }
+      transfer( committee_account, seller_id, asset( 100000000 ) );
+      borrow( seller, bitusd.amount( 1000000 ), asset( 10000000 ) );
+      transfer( committee_account, buyer_id, asset( 100000000 ) );
+      generate_block();
+
+      uint32_t sequence = 0;
+      auto push_order = [&]( account_id_type who, asset amount, asset to_receive ) {
+         signed_transaction tx;
+         limit_order_create_operation op;
+         op.seller = who;
+         op.amount_to_sell = amount;
+         op.min_to_receive = to_receive;
+         op.fee = db.current_fee_schedule().calculate_fee( op );
+         tx.operations.push_back( op );
+         // distinct expirations keep the transaction IDs apart
+         tx.set_expiration( db.head_block_time() + fc::minutes(1) + fc::seconds( sequence++ % 3000 ) );
+         tx.set_reference_block( db.head_block_id() );
+         db.push_transaction( tx, ~0 );
+      };
+
+      fc::time_point start_time = fc::time_point::now();
+      for( uint32_t i = 0; i < order_pairs; ++i )
+      {
+         // 10 CORE per USD, far below the max short squeeze price of 5.5 CORE per USD for the calls
+         push_order( seller_id, asset( 10, usd_id ), asset( 100 ) );
+         push_order( buyer_id, asset( 100 ), asset( 10, usd_id ) );
+         if( ( i + 1 ) % 1000 == 0 )
+            generate_block();
+      }
+      const int64_t match_us = (fc::time_point::now() - start_time).count();
+      BOOST_CHECK_EQUAL( db.get_limit_order_books().find_side( usd_id, asset_id_type() ) == nullptr, true );
+
+      const uint32_t check_count = 100000;
+      start_time = fc::time_point::now();
+      uint32_t need_check = 0;
+      for( uint32_t i = 0; i < check_count; ++i )
+         need_check += db.call_orders_need_check( bitusd );
+      const int64_t check_us = (fc::time_point::now() - start_time).count();
+      BOOST_CHECK_EQUAL( need_check, 0u );
+
+      ilog( "${p} matched order pairs against ${c} call orders in ${t} ms, ${r} orders/s; call_orders_need_check takes ${n} ns",
+            ("p",order_pairs)("c",call_count)("t",match_us / 1000)
+            ("r",uint64_t( 2.0 * order_pairs * 1000000 / std::max<int64_t>( match_us, 1 ) ))
+            ("n",check_us * 1000 / check_count) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+/**
+ * Compares the per-modify cost of the type erased database::modify with the statically
+ * dispatched database::modify_in on account_balance_index.
+ */
+BOOST_FIXTURE_TEST_CASE( modify_dispatch_bench, database_fixture )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t modify_count = 10000000;
+#else
+      const uint32_t modify_count = 100000;
+#endif
+
+      ACTORS( (alice) );
+      transfer( committee_account, alice_id, asset( 1000000 ) );
+      generate_block();
+
+      const auto& by_account = db.get_index_type<account_balance_index>().indices().get<by_account_asset>();
+      const account_balance_object& balance = *by_account.find( boost::make_tuple( alice_id, asset_id_type() ) );
+
+      // all modifications are undone when the session ends
+      auto session = db._undo_db.start_undo_session();
+
+      fc::time_point start_time = fc::time_point::now();
+      for( uint32_t i = 0; i < modify_count; ++i )
+         db.modify( balance, []( account_balance_object& b ){ b.balance += 1; } );
+      const int64_t erased_us = (fc::time_point::now() - start_time).count();
+
+      start_time = fc::time_point::now();
+      for( uint32_t i = 0; i < modify_count; ++i )
+         db.modify_in<account_balance_index>( balance, []( account_balance_object& b ){ b.balance -= 1; } );
+      const int64_t static_us = (fc::time_point::now() - start_time).count();
+
+      BOOST_CHECK_EQUAL( balance.balance.value, 1000000 );
+      ilog( "${c} modifies of an account_balance_object: ${e} ns each through modify, ${s} ns each through modify_in",
+            ("c",modify_count)
+            ("e",double(erased_us) * 1000 / modify_count)
+            ("s",double(static_us) * 1000 / modify_count) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
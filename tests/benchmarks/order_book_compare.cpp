@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/market_object.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <random>
+
+using namespace graphene::chain;
+
+namespace {
+
+template<typename PriceCompare>
+using order_book = multi_index_container<
+   limit_order_object,
+   indexed_by<
+      ordered_unique< tag<by_price>,
+         composite_key< limit_order_object,
+            member< limit_order_object, price, &limit_order_object::sell_price>,
+            member< object, object_id_type, &object::id>
+         >,
+         composite_key_compare< PriceCompare, std::less<object_id_type> >
+      >
+   >
+>;
+
+/**
+ * Inserts the orders into a book ordered with PriceCompare, then matches one taker against the book
+ * per order the way apply_order does: the best maker is the lower bound of the maximum price and it
+ * matches if it is not past the taker's limit.
+ */
+template<typename PriceCompare>
+void run_order_book( const char* name, const vector<limit_order_object>& orders, const vector<price>& takers )
+{
+   order_book<PriceCompare> book;
+   auto& by_price_idx = book.template get<by_price>();
+
+   fc::time_point start_time = fc::time_point::now();
+   for( const limit_order_object& o : orders )
+      book.insert( o );
+   const int64_t insert_us = (fc::time_point::now() - start_time).count();
+
+   uint64_t matched = 0;
+   start_time = fc::time_point::now();
+   for( const price& taker : takers )
+   {
+      const price max_price = ~taker;
+      auto itr = by_price_idx.lower_bound( max_price.max() );
+      auto end = by_price_idx.upper_bound( max_price );
+      if( itr != end )
+      {
+         by_price_idx.erase( itr );
+         ++matched;
+      }
+   }
+   const int64_t match_us = (fc::time_point::now() - start_time).count();
+
+   ilog( "${n}: inserted ${c} orders in ${i} ms, matched ${m} of ${t} takers in ${r} ms",
+         ("n",name)("c",orders.size())("i",insert_us / 1000)("m",matched)("t",takers.size())("r",match_us / 1000) );
+}
+
+}
+
+/**
+ * Inserting and matching a million limit orders in a by_price index ordered with the native price
+ * comparator and with std::greater<price>, which goes through the out-of-line price operators.
+ */
+BOOST_AUTO_TEST_CASE( order_book_compare_bench )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t order_count = 1000000;
+#else
+      const uint32_t order_count = 100000;
+#endif
+      const asset_id_type core_id;
+      const asset_id_type usd_id( 1 );
+
+      std::mt19937_64 rng( 1 );
+      std::uniform_int_distribution<int64_t> amount( 1, GRAPHENE_MAX_SHARE_SUPPLY / 1000 );
+
+      vector<limit_order_object> orders( order_count );
+      vector<price> takers( order_count );
+      for( uint32_t i = 0; i < order_count; ++i )
+      {
+         orders[i].id = limit_order_id_type( i );
+         orders[i].sell_price = price( asset( amount( rng ), core_id ), asset( amount( rng ), usd_id ) );
+         orders[i].for_sale = orders[i].sell_price.base.amount;
+         takers[i] = price( asset( amount( rng ), usd_id ), asset( amount( rng ), core_id ) );
+      }
+
+      run_order_book<price_greater>( "price_greater", orders, takers );
+      run_order_book< std::greater<price> >( "std::greater<price>", orders, takers );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+/**
+ * Time taken by generate_block with thousands of pending transactions, when the state of the pending
+ * transactions is kept and when all of them have to be applied again because they were pushed with
+ * fewer checks than the block is generated with.
+ */
+BOOST_FIXTURE_TEST_CASE( pending_generation_bench, database_fixture )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t tx_count = 10000;
+#else
+      const uint32_t tx_count = 2000;
+#endif
+
+      ACTORS( (alice)(bob) );
+      transfer( committee_account, alice_id, asset( GRAPHENE_MAX_SHARE_SUPPLY / 2 ) );
+      generate_block();
+
+      uint32_t sequence = 0;
+      auto push_transfers = [&]() {
+         for( uint32_t i = 0; i < tx_count; ++i )
+         {
+            signed_transaction tx;
+            transfer_operation xfer;
+            xfer.from = alice_id;
+            xfer.to = bob_id;
+            // distinct amounts keep the transaction IDs apart
+            xfer.amount = asset( 1 + sequence++ % 1000 );
+            xfer.fee = db.current_fee_schedule().calculate_fee( xfer );
+            tx.operations.push_back( xfer );
+            tx.set_expiration( db.head_block_time() + fc::minutes(1) + fc::seconds( sequence / 1000 ) );
+            tx.set_reference_block( db.head_block_id() );
+            PUSH_TX( db, tx, ~0 );
+         }
+      };
+
+      const uint32_t generate_skip = ~0 & ~database::skip_tapos_check;
+
+      push_transfers();
+      fc::time_point start_time = fc::time_point::now();
+      signed_block kept = generate_block( ~0 );
+      const int64_t kept_us = (fc::time_point::now() - start_time).count();
+      BOOST_CHECK_EQUAL( kept.transactions.size(), tx_count );
+
+      push_transfers();
+      start_time = fc::time_point::now();
+      signed_block reapplied = generate_block( generate_skip );
+      const int64_t reapplied_us = (fc::time_point::now() - start_time).count();
+      BOOST_CHECK_EQUAL( reapplied.transactions.size(), tx_count );
+
+      ilog( "Generated blocks of ${c} pending transfers in ${k} ms keeping the pending state, ${r} ms applying them again",
+            ("c",tx_count)("k",kept_us / 1000)("r",reapplied_us / 1000) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
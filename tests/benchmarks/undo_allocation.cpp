@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+/**
+ * Pushes transfers in per-transaction undo sessions and reports how many allocations the undo
+ * bookkeeping made per transaction.  "requested" is what every copy and hash node used to cost
+ * in calls to the heap, "heap" is what reaches the heap through the undo pool.
+ */
+BOOST_FIXTURE_TEST_CASE( undo_allocation_bench, database_fixture )
+{
+   try {
+#ifdef NDEBUG
+      const uint32_t transaction_count = 200000;
+#else
+      const uint32_t transaction_count = 5000;
+#endif
+      const uint32_t transactions_per_block = 100;
+
+      ACTORS( (alice)(bob) );
+      transfer( committee_account, alice_id, asset( GRAPHENE_MAX_SHARE_SUPPLY / 2 ) );
+      generate_block();
+
+      auto run = [&]( uint32_t count ) {
+         const undo_pool& pool = db._undo_db.pool();
+         const uint64_t requested = pool.allocations();
+         const uint64_t heap      = pool.heap_allocations();
+         fc::time_point start_time = fc::time_point::now();
+         for( uint32_t i = 0; i < count; ++i )
+         {
+            signed_transaction tx;
+            transfer_operation op;
+            op.from   = alice_id;
+            op.to     = bob_id;
+            // distinct within a block, so no two transactions are duplicates
+            op.amount = asset( 1 + i % transactions_per_block );
+            tx.operations.push_back( op );
+            db.current_fee_schedule().set_fee( tx.operations.back() );
+            set_expiration( db, tx );
+            db.push_transaction( tx, ~0 );
+            if( ( i + 1 ) % transactions_per_block == 0 )
+               generate_block();
+         }
+         ilog( "${c} transfers in ${t} ms, undo allocations per transaction: ${r} requested, ${h} from the heap",
+               ("c",count)("t",(fc::time_point::now() - start_time).count() / 1000)
+               ("r",double(pool.allocations() - requested) / count)
+               ("h",double(pool.heap_allocations() - heap) / count) );
+      };
+
+      ilog( "Cold undo pool:" );
+      run( transactions_per_block );
+      ilog( "Warm undo pool:" );
+      run( transaction_count );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -193,6 +193,27 @@ void database_fixture::verify_asset_supplies( const database& db )
       {
          const auto& bad = asset_obj.bitasset_data(db);
          total_balances[bad.options.short_backing_asset] += bad.settlement_fund;
+         BOOST_CHECK( bad.asset_id == asset_obj.id );
+         // core exchange rates are synchronized with the feed at the end of each block
+         if( !bad.core_exchange_rate_changed && !bad.current_feed.core_exchange_rate.is_null() )
+            BOOST_CHECK( asset_obj.options.core_exchange_rate == bad.current_feed.core_exchange_rate );
+
+         // the call order view must match the call orders
+         const auto& call_price_index = db.get_index_type<call_order_index>().indices().get<by_price>();
+         auto call_itr = call_price_index.lower_bound( price::min( bad.options.short_backing_asset, asset_obj.id ) );
+         auto call_end = call_price_index.upper_bound( price::max( bad.options.short_backing_asset, asset_obj.id ) );
+         BOOST_CHECK_EQUAL( bad.least_collateralized_call.valid(), call_itr != call_end );
+         if( bad.least_collateralized_call.valid() && call_itr != call_end )
+         {
+            BOOST_CHECK( *bad.least_collateralized_call == call_itr->id );
+            BOOST_CHECK( bad.least_collateralized_call_price == call_itr->call_price );
+            BOOST_CHECK( bad.least_collateralization == call_itr->collateralization() );
+         }
+         uint32_t calls_below_maintenance = 0;
+         for( ; call_itr != call_end; ++call_itr )
+            if( db.is_below_maintenance( *call_itr, bad ) )
+               ++calls_below_maintenance;
+         BOOST_CHECK_EQUAL( bad.calls_below_maintenance, calls_below_maintenance );
       }
       total_balances[asset_obj.id] += dasset_obj.confidential_supply.value;
    }
@@ -25,6 +25,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <graphene/chain/database.hpp>
+#include <graphene/chain/protocol/signature_key_cache.hpp>
 #include <graphene/chain/protocol/protocol.hpp>
 #include <graphene/chain/exceptions.hpp>
 
@@ -1403,4 +1404,110 @@ BOOST_FIXTURE_TEST_CASE( parent_owner_test, database_fixture )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( signature_keys_cache, database_fixture )
+{
+   try
+   {
+      ACTORS( (alice)(bob) );
+      const chain_id_type& chain_id = db.get_chain_id();
+
+      transfer_operation xfer_op;
+      xfer_op.from = alice_id;
+      xfer_op.to = bob_id;
+      xfer_op.amount = asset(500);
+
+      signed_transaction tx;
+      tx.operations.push_back( xfer_op );
+      tx.set_expiration( db.head_block_time() + fc::minutes(1) );
+      tx.sign( alice_private_key, chain_id );
+
+      flat_set<public_key_type> alice_only = { alice_public_key };
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == alice_only );
+      // repeated lookups use the recovered keys, copies recover them again
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == alice_only );
+      processed_transaction ptx( tx );
+      BOOST_CHECK( ptx.get_signature_keys( chain_id ) == alice_only );
+      signed_transaction assigned;
+      assigned = tx;
+      BOOST_CHECK( assigned.get_signature_keys( chain_id ) == alice_only );
+      // a copy which is signed again does not return the keys of the original
+      assigned.signatures.clear();
+      assigned.sign( bob_private_key, chain_id );
+      BOOST_CHECK( assigned.get_signature_keys( chain_id ) == flat_set<public_key_type>{ bob_public_key } );
+
+      // adding a signature changes the result
+      tx.sign( bob_private_key, chain_id );
+      flat_set<public_key_type> both = { alice_public_key, bob_public_key };
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == both );
+
+      // replacing a signature changes the result
+      tx.signatures.clear();
+      tx.sign( bob_private_key, chain_id );
+      flat_set<public_key_type> bob_only = { bob_public_key };
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == bob_only );
+
+      // changing the content changes the digest, so the old signature no longer yields bob's key
+      tx.operations.push_back( xfer_op );
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) != bob_only );
+
+      // a different chain ID gives a different digest too
+      tx.operations.pop_back();
+      BOOST_CHECK( tx.get_signature_keys( chain_id ) == bob_only );
+      BOOST_CHECK( tx.get_signature_keys( chain_id_type() ) != bob_only );
+   }
+   FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( signature_key_cache_test, database_fixture )
+{
+   try
+   {
+      ACTORS( (alice)(bob) );
+      const chain_id_type& chain_id = db.get_chain_id();
+
+      transfer_operation xfer_op;
+      xfer_op.from = alice_id;
+      xfer_op.to = bob_id;
+      xfer_op.amount = asset(500);
+
+      // builds a new instance each time, so nothing is remembered by the transaction itself
+      auto make_tx = [&]( const private_key_type& key ) {
+         signed_transaction tx;
+         tx.operations.push_back( xfer_op );
+         tx.set_expiration( db.head_block_time() + fc::minutes(1) );
+         tx.sign( key, chain_id );
+         return tx;
+      };
+
+      signature_key_cache::clear();
+      flat_set<public_key_type> alice_only = { alice_public_key };
+      BOOST_CHECK( make_tx( alice_private_key ).get_signature_keys( chain_id ) == alice_only );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().misses, 1u );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().hits, 0u );
+
+      BOOST_CHECK( make_tx( alice_private_key ).get_signature_keys( chain_id ) == alice_only );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().misses, 1u );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().hits, 1u );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().size, 1u );
+
+      // the least recently used key is evicted
+      signature_key_cache::set_capacity( 1 );
+      flat_set<public_key_type> bob_only = { bob_public_key };
+      BOOST_CHECK( make_tx( bob_private_key ).get_signature_keys( chain_id ) == bob_only );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().size, 1u );
+      BOOST_CHECK( make_tx( alice_private_key ).get_signature_keys( chain_id ) == alice_only );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().misses, 3u );
+
+      // a disabled cache still recovers the keys
+      signature_key_cache::set_capacity( 0 );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().size, 0u );
+      BOOST_CHECK( make_tx( bob_private_key ).get_signature_keys( chain_id ) == bob_only );
+      BOOST_CHECK_EQUAL( signature_key_cache::get_statistics().size, 0u );
+
+      signature_key_cache::set_capacity( signature_key_cache::default_capacity );
+      signature_key_cache::clear();
+   }
+   FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -170,6 +170,19 @@ BOOST_AUTO_TEST_CASE( price_test )
     BOOST_CHECK(a == c);
     BOOST_CHECK(!(b == c));
 
+    BOOST_CHECK( compare_prices( a, b ) < 0 );
+    BOOST_CHECK( compare_prices( b, a ) > 0 );
+    BOOST_CHECK( compare_prices( a, c ) == 0 );
+    BOOST_CHECK( compare_prices( price_max(0,1), price_min(1,0) ) < 0 );
+    BOOST_CHECK( price_less()( price_min(0,1), price_max(0,1) ) );
+    BOOST_CHECK( price_greater()( price_max(0,1), price_min(0,1) ) );
+    BOOST_CHECK( !price_less()( a, c ) && !price_greater()( a, c ) );
+    // cross products beyond 64 bits
+    price big(asset(GRAPHENE_MAX_SHARE_SUPPLY), asset(GRAPHENE_MAX_SHARE_SUPPLY - 1, asset_id_type(1)));
+    price bigger(asset(GRAPHENE_MAX_SHARE_SUPPLY - 1), asset(GRAPHENE_MAX_SHARE_SUPPLY - 2, asset_id_type(1)));
+    BOOST_CHECK( compare_prices( big, bigger ) < 0 );
+    BOOST_CHECK( big < bigger );
+
     price_feed dummy;
     dummy.maintenance_collateral_ratio = 1002;
     dummy.maximum_short_squeeze_ratio = 1234;
@@ -34,9 +34,13 @@
 #include <graphene/chain/market_object.hpp>
 
 #include <graphene/utilities/tempdir.hpp>
+#include <graphene/db/object_snapshot.hpp>
 
 #include <fc/crypto/digest.hpp>
 
+#include <atomic>
+#include <thread>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -125,6 +129,131 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_concurrent_reads )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 200; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         blocks.push_back( b );
+      }
+      for( uint32_t i = 0; i < 100; ++i )
+         bdb.store( blocks[i].id(), blocks[i] );
+
+      // readers see every stored block while the rest are being written
+      std::atomic<uint32_t> stored( 100 );
+      std::atomic<uint32_t> failures( 0 );
+      vector<std::thread> readers;
+      for( uint32_t t = 0; t < 4; ++t )
+         readers.emplace_back( [&,t]() {
+            for( uint32_t n = 0; n < 2000; ++n )
+            {
+               const uint32_t num = ( n * 7 + t ) % stored.load() + 1;
+               auto blk = bdb.fetch_by_number( num );
+               if( !blk.valid() || blk->id() != blocks[num-1].id() || !bdb.contains( blocks[num-1].id() ) )
+                  ++failures;
+            }
+         });
+      for( uint32_t i = 100; i < 200; ++i )
+      {
+         bdb.store( blocks[i].id(), blocks[i] );
+         stored = i + 1;
+      }
+      for( auto& reader : readers )
+         reader.join();
+      BOOST_CHECK_EQUAL( failures.load(), 0u );
+
+      // removed blocks at the end are skipped
+      bdb.remove( blocks[199].id() );
+      BOOST_CHECK( !bdb.contains( blocks[199].id() ) );
+      BOOST_CHECK( *bdb.last_id() == blocks[198].id() );
+      BOOST_CHECK( !bdb.fetch_by_number( 200 ).valid() );
+      bdb.store( blocks[199].id(), blocks[199] );
+      BOOST_CHECK( bdb.fetch_by_number( 200 )->id() == blocks[199].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_segments )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      vector<signed_block> blocks;
+      signed_block b;
+      for( uint32_t i = 0; i < 100; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i % 3 + 1);
+         b.timestamp = fc::time_point_sec( GRAPHENE_TESTING_GENESIS_TIMESTAMP + 3 * i );
+         blocks.push_back( b );
+      }
+
+      // write the first half in the unsegmented format
+      {
+         std::ofstream index( (data_dir.path() / "index").generic_string().c_str(), std::ios::binary );
+         std::ofstream data( (data_dir.path() / "blocks").generic_string().c_str(), std::ios::binary );
+         struct { uint64_t block_pos = 0; uint32_t block_size = 0; block_id_type block_id; } entry;
+         index.write( (const char*)&entry, sizeof(entry) );
+         for( uint32_t i = 0; i < 50; ++i )
+         {
+            const auto packed = fc::raw::pack( blocks[i] );
+            entry.block_pos = data.tellp();
+            entry.block_size = packed.size();
+            entry.block_id = blocks[i].id();
+            data.write( packed.data(), packed.size() );
+            index.write( (const char*)&entry, sizeof(entry) );
+         }
+      }
+
+      // left over from an interrupted conversion
+      fc::create_directories( data_dir.path() / "converting" );
+      std::ofstream( (data_dir.path() / "converting" / "segment-00000000").generic_string().c_str() ) << "partial";
+      std::ofstream( (data_dir.path() / "segment-00000001").generic_string().c_str() ) << "partial";
+
+      block_database bdb( 16 );
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( !fc::exists( data_dir.path() / "index" ) );
+      BOOST_CHECK( !fc::exists( data_dir.path() / "converting" ) );
+      BOOST_CHECK( *bdb.last_id() == blocks[49].id() );
+      for( uint32_t i = 50; i < 100; ++i )
+         bdb.store( blocks[i].id(), blocks[i] );
+      for( uint32_t i = 0; i < 100; ++i )
+         BOOST_CHECK( bdb.fetch_by_number( i + 1 )->id() == blocks[i].id() );
+      // the index of the last segment only has entries up to block 100
+      BOOST_CHECK_LT( fc::file_size( data_dir.path() / "segment-00000006.index" ),
+                      fc::file_size( data_dir.path() / "segment-00000005.index" ) );
+      BOOST_CHECK( !bdb.fetch_by_number( 101 ).valid() );
+
+      // the capacity of existing segments is kept
+      bdb.close();
+      block_database reopened;
+      reopened.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( reopened.segment_capacity(), 16u );
+      BOOST_CHECK( reopened.last()->id() == blocks[99].id() );
+
+      // segments 0 to 2 hold blocks 1 to 47
+      BOOST_CHECK_EQUAL( reopened.prune( 50 ), 3u );
+      BOOST_CHECK( !reopened.contains( blocks[46].id() ) );
+      BOOST_CHECK( !reopened.fetch_by_number( 47 ).valid() );
+      BOOST_CHECK( reopened.fetch_by_number( 48 )->id() == blocks[47].id() );
+      BOOST_CHECK( reopened.fetch_optional( blocks[99].id() ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( generate_empty_blocks )
 {
    try {
@@ -184,6 +313,182 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
+BOOST_AUTO_TEST_CASE( object_journal )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      fc::path journal = data_dir.path() / "object_database" / "journal";
+      uint32_t head_num;
+      block_id_type head_id;
+      share_type witness_pay;
+      {
+         database db;
+         db.enable_journal( 1024*1024*1024 );
+         db.open(data_dir.path(), make_genesis, "TEST");
+         // genesis is applied without undo, so it can only be persisted by a full flush
+         db.close();
+         BOOST_CHECK( fc::exists( journal ) );
+         BOOST_CHECK_EQUAL( fc::file_size( journal ), 0u );
+      }
+      {
+         database db;
+         db.enable_journal( 1024*1024*1024 );
+         db.open(data_dir.path(), make_genesis, "TEST");
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing );
+         head_num = db.head_block_num();
+         head_id = db.head_block_id();
+         witness_pay = db.get_dynamic_global_properties().witness_budget;
+         db.close();
+         BOOST_CHECK( fc::file_size( journal ) > 0 );
+      }
+      {
+         // the journal is replayed on top of the last flush even if it is disabled now
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         BOOST_CHECK( db.get_dynamic_global_properties().witness_budget == witness_pay );
+         db.close();
+         // without the journal, close() falls back to a full flush which starts over
+         BOOST_CHECK( !fc::exists( journal ) );
+      }
+      {
+         // a journal which grows beyond the compaction size is replaced by a flush while running
+         database db;
+         db.enable_journal( 4096 );
+         db.open(data_dir.path(), make_genesis, "TEST");
+         const uint64_t flush_id = graphene::db::object_database::read_flush_id( data_dir.path() );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing );
+         BOOST_CHECK( graphene::db::object_database::read_flush_id( data_dir.path() ) != flush_id );
+         BOOST_CHECK_LT( fc::file_size( journal ), 4096u * 2 );
+         head_num = db.head_block_num();
+         head_id = db.head_block_id();
+         db.close();
+      }
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.close();
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( corrupt_index_file )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         db.close();
+      }
+      fc::path account_file = data_dir.path() / "object_database"
+                              / fc::to_string( uint32_t(protocol_ids) ) / fc::to_string( uint32_t(account_object_type) );
+      BOOST_REQUIRE( fc::exists( account_file ) );
+      {
+         // flip a byte of the first account
+         std::fstream f( account_file.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+         const auto pos = fc::raw::pack_size( graphene::db::index_file_header() ) + 4;
+         char c;
+         f.seekg( pos );
+         f.read( &c, 1 );
+         c ^= 0x55;
+         f.seekp( pos );
+         f.write( &c, 1 );
+      }
+      {
+         database db;
+         GRAPHENE_REQUIRE_THROW( db.open(data_dir.path(), make_genesis, "TEST"), fc::exception );
+         BOOST_CHECK( !db.find( account_id_type() ) );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( object_snapshot )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         db.close();
+      }
+      graphene::db::object_snapshot snapshot;
+      snapshot.open( data_dir.path() );
+
+      database db;
+      db.open(data_dir.path(), make_genesis, "TEST");
+      const auto& accounts = db.get_index_type<account_index>().indices();
+      BOOST_REQUIRE( !accounts.empty() );
+      for( const account_object& a : accounts )
+      {
+         auto copy = snapshot.find<account_object>( a.id );
+         BOOST_REQUIRE( copy.valid() );
+         BOOST_CHECK( copy->id == a.id );
+         BOOST_CHECK_EQUAL( copy->name, a.name );
+
+         const char* data;
+         size_t size;
+         BOOST_REQUIRE( snapshot.find_serialized( a.id, data, size ) );
+         BOOST_CHECK( std::vector<char>( data, data + size ) == fc::raw::pack( a ) );
+      }
+      BOOST_CHECK( !snapshot.find<account_object>( db.get_index<account_object>().get_next_id() ).valid() );
+      BOOST_CHECK( !snapshot.find<asset_object>( asset_id_type( 1000 ) ).valid() );
+
+      auto by_owner = snapshot.build_key_table<account_balance_object>( []( const account_balance_object& b ) {
+         return b.owner.instance.value;
+      });
+      BOOST_CHECK_EQUAL( by_owner.size(), db.get_index_type<account_balance_index>().indices().size() );
+      BOOST_CHECK( std::is_sorted( by_owner.begin(), by_owner.end() ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( object_snapshot_flush_id )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         db.close();
+      }
+      graphene::db::object_snapshot snapshot;
+      snapshot.open( data_dir.path() );
+      BOOST_CHECK( snapshot.flush_id() != 0 );
+      BOOST_CHECK_EQUAL( snapshot.flush_id(), graphene::db::object_database::read_flush_id( data_dir.path() ) );
+
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST");
+         db.close();
+      }
+      // the flush replaced the files, the mapped ones stay readable
+      BOOST_CHECK( snapshot.flush_id() != graphene::db::object_database::read_flush_id( data_dir.path() ) );
+      BOOST_CHECK( snapshot.find<account_object>( account_id_type() ).valid() );
+
+      snapshot.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( snapshot.flush_id(), graphene::db::object_database::read_flush_id( data_dir.path() ) );
+      BOOST_CHECK( snapshot.find<account_object>( account_id_type() ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( undo_block )
 {
    try {
@@ -285,11 +590,20 @@ BOOST_AUTO_TEST_CASE( fork_blocks )
       }
       BOOST_CHECK_EQUAL(db1.head_block_num(), 13);
       BOOST_CHECK_EQUAL(db1.head_block_id().str(), db1_tip);
+      // the merkle root of the invalid block was checked before any block was popped
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().switch_count, 1u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().failed_count, 1u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().rejected_before_unwind_count, 1u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().last_popped_blocks, 0u);
 
       // assert that db1 switches to new fork with good block
       BOOST_CHECK_EQUAL(db2.head_block_num(), 14);
       PUSH_BLOCK( db1, good_block );
       BOOST_CHECK_EQUAL(db1.head_block_id().str(), db2.head_block_id().str());
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().switch_count, 2u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().failed_count, 1u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().last_popped_blocks, 3u);
+      BOOST_CHECK_EQUAL(db1.get_fork_switch_stats().last_applied_blocks, 4u);
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
@@ -324,6 +638,111 @@ BOOST_AUTO_TEST_CASE( fork_db_tests )
      FC_ASSERT( head && head->data.block_num() == 2001, "", ("head",head->data.block_num()) );
   } FC_LOG_AND_RETHROW() 
 }
+BOOST_AUTO_TEST_CASE( fork_database_branches )
+{
+   try {
+      fork_database fdb;
+      auto make_block = []( const signed_block& prev, uint32_t variant ) {
+         signed_block b;
+         b.previous = prev.id();
+         b.timestamp = prev.timestamp + variant + 1;
+         return b;
+      };
+
+      // a main chain of 10 blocks and a fork of 3 blocks off block 7
+      vector<signed_block> chain( 1 );
+      fdb.start_block( chain[0] );
+      for( uint32_t i = 1; i < 10; ++i )
+      {
+         chain.push_back( make_block( chain.back(), 0 ) );
+         fdb.push_block( chain.back() );
+      }
+      vector<signed_block> fork( 1, make_block( chain[7], 1 ) );
+      fdb.push_block( fork.back() );
+      for( uint32_t i = 1; i < 3; ++i )
+      {
+         fork.push_back( make_block( fork.back(), 1 ) );
+         fdb.push_block( fork.back() );
+      }
+      BOOST_CHECK( fdb.head()->id == fork.back().id() );
+
+      auto branches = fdb.fetch_branch_from( fork.back().id(), chain.back().id() );
+      BOOST_REQUIRE_EQUAL( branches.first.size(), 3u );
+      BOOST_REQUIRE_EQUAL( branches.second.size(), 2u );
+      BOOST_CHECK( branches.first.back()->previous_id() == chain[7].id() );
+      BOOST_CHECK( branches.second.back()->previous_id() == chain[7].id() );
+      // the items refer to a shared copy of each block
+      BOOST_CHECK( branches.first.front()->data.id() == fork.back().id() );
+      BOOST_CHECK( &branches.first.front()->data == branches.first.front()->block.get() );
+
+      // removing the head falls back to its parent
+      fdb.remove( fork.back().id() );
+      BOOST_CHECK( fdb.head()->id == fork[1].id() );
+      BOOST_CHECK( !fdb.is_known_block( fork.back().id() ) );
+
+      // pruning unlinks the children of pruned items
+      fdb.set_max_size( 1 );
+      BOOST_CHECK( !fdb.is_known_block( chain[7].id() ) );
+      BOOST_REQUIRE( fdb.fetch_block( fork[0].id() ) );
+      BOOST_CHECK( fdb.fetch_block( fork[0].id() )->prev == nullptr );
+      BOOST_CHECK( fdb.fetch_block( chain[9].id() )->prev == fdb.fetch_block( chain[8].id() ) );
+
+      // items are recycled once retired
+      for( uint32_t i = 0; i < 1000; ++i )
+      {
+         signed_block b = make_block( chain.back(), i );
+         fdb.reset();
+         fdb.start_block( b );
+         BOOST_CHECK( fdb.head()->id == b.id() );
+      }
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_set_head_after_prune )
+{
+   try {
+      fork_database fdb;
+      auto make_block = []( const signed_block& prev, uint32_t variant ) {
+         signed_block b;
+         b.previous = prev.id();
+         b.timestamp = prev.timestamp + variant + 1;
+         return b;
+      };
+
+      // a main chain of 6 blocks and a longer fork off block 2
+      vector<signed_block> chain( 1 );
+      fdb.start_block( chain[0] );
+      for( uint32_t i = 1; i < 6; ++i )
+      {
+         chain.push_back( make_block( chain.back(), 0 ) );
+         fdb.push_block( chain.back() );
+      }
+      vector<signed_block> fork( 1, make_block( chain[2], 1 ) );
+      fdb.push_block( fork.back() );
+      for( uint32_t i = 1; i < 5; ++i )
+      {
+         fork.push_back( make_block( fork.back(), 1 ) );
+         fdb.push_block( fork.back() );
+      }
+      BOOST_REQUIRE( fdb.head()->id == fork.back().id() );
+
+      // switching to the fork advances irreversibility and prunes the old branch, then the switch fails
+      auto branches = fdb.fetch_branch_from( fork.back().id(), chain.back().id() );
+      fdb.set_max_size( 1 );
+      BOOST_CHECK( !fdb.is_known_block( chain[5].id() ) );
+      fdb.set_head( branches.second.front() );
+      BOOST_CHECK( fdb.head()->id == chain[5].id() );
+      BOOST_CHECK( fdb.is_known_block( chain[5].id() ) );
+
+      // the next push reclaims the retired items but not the head
+      chain.push_back( make_block( chain.back(), 0 ) );
+      fdb.push_block( chain.back() );
+      BOOST_REQUIRE( fdb.fetch_block( chain[6].id() ) );
+      BOOST_CHECK( fdb.fetch_block( chain[6].id() )->prev == fdb.fetch_block( chain[5].id() ) );
+      BOOST_CHECK( fdb.fetch_block( chain[5].id() )->data.id() == chain[5].id() );
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_CASE( out_of_order_blocks )
 {
    try {
@@ -547,6 +966,191 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
       GRAPHENE_CHECK_THROW(PUSH_TX( db2, trx, skip_sigs ), fc::exception);
       BOOST_CHECK_EQUAL(db1.get_balance(nathan_id, asset_id_type()).amount.value, 500);
       BOOST_CHECK_EQUAL(db2.get_balance(nathan_id, asset_id_type()).amount.value, 500);
+
+      // the transaction is served from the recent transaction cache of both nodes
+      BOOST_CHECK( db2.is_known_transaction( trx.id() ) );
+      BOOST_CHECK( db2.get_recent_transaction( trx.id() ).id() == trx.id() );
+      BOOST_CHECK( db1.get_recent_transaction( trx.id() ).signatures == trx.signatures );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( recent_transaction_expiration, database_fixture )
+{
+   try {
+      ACTOR( alice );
+      generate_block();
+
+      signed_transaction tx;
+      transfer_operation xfer;
+      xfer.from = account_id_type();
+      xfer.to = alice_id;
+      xfer.amount = asset(1000);
+      tx.operations.push_back( xfer );
+      tx.set_expiration( db.head_block_time() + db.get_global_properties().parameters.block_interval * 3 );
+      tx.set_reference_block( db.head_block_id() );
+      PUSH_TX( db, tx, ~0 & ~database::skip_transaction_dupe_check );
+      generate_block( ~0 & ~database::skip_transaction_dupe_check );
+
+      const transaction_id_type id = tx.id();
+      BOOST_CHECK( db.is_known_transaction( id ) );
+      BOOST_CHECK( db.get_recent_transaction( id ).operations.size() == 1 );
+      const auto& dedupe = db.get_index_type<transaction_index>().indices().get<by_trx_id>();
+      BOOST_REQUIRE( dedupe.find( id ) != dedupe.end() );
+      BOOST_CHECK( dedupe.find( id )->expiration == tx.expiration );
+
+      // both the ID and the transaction are dropped once it expires
+      generate_blocks( tx.expiration + db.get_global_properties().parameters.block_interval );
+      BOOST_CHECK( !db.is_known_transaction( id ) );
+      GRAPHENE_REQUIRE_THROW( db.get_recent_transaction( id ), fc::exception );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( recent_transaction_rollback, database_fixture )
+{
+   try {
+      ACTOR( alice );
+      generate_block();
+      const uint32_t skip = ~0 & ~database::skip_transaction_dupe_check;
+
+      // a transaction which fails is not served
+      signed_transaction bad_tx;
+      transfer_operation bad_xfer;
+      bad_xfer.from = alice_id;
+      bad_xfer.to = account_id_type();
+      bad_xfer.amount = asset(1000);
+      bad_tx.operations.push_back( bad_xfer );
+      set_expiration( db, bad_tx );
+      GRAPHENE_REQUIRE_THROW( PUSH_TX( db, bad_tx, skip ), fc::exception );
+      BOOST_CHECK( !db.is_known_transaction( bad_tx.id() ) );
+      GRAPHENE_REQUIRE_THROW( db.get_recent_transaction( bad_tx.id() ), fc::exception );
+
+      // nor is a transaction of a popped block
+      signed_transaction tx;
+      transfer_operation xfer;
+      xfer.from = account_id_type();
+      xfer.to = alice_id;
+      xfer.amount = asset(1000);
+      tx.operations.push_back( xfer );
+      set_expiration( db, tx );
+      PUSH_TX( db, tx, skip );
+      generate_block( skip );
+      BOOST_CHECK( db.get_recent_transaction( tx.id() ).operations.size() == 1 );
+
+      db.pop_block();
+      BOOST_CHECK( !db.is_known_transaction( tx.id() ) );
+      GRAPHENE_REQUIRE_THROW( db.get_recent_transaction( tx.id() ), fc::exception );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_FIXTURE_TEST_CASE( generate_block_keeps_pending_state, database_fixture )
+{
+   try {
+      ACTORS( (alice)(bob) );
+      transfer( committee_account, alice_id, asset( 1000000 ) );
+      generate_block();
+
+      const uint32_t skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      int tx_count = 0;
+      auto push_transfer = [&]( uint32_t skip ) {
+         signed_transaction tx;
+         transfer_operation xfer;
+         xfer.from = alice_id;
+         xfer.to = bob_id;
+         xfer.amount = asset( 1000 + tx_count++ );
+         xfer.fee = db.current_fee_schedule().calculate_fee( xfer );
+         tx.operations.push_back( xfer );
+         tx.set_expiration( db.head_block_time() + fc::minutes(1) );
+         tx.set_reference_block( db.head_block_id() );
+         PUSH_TX( db, tx, skip );
+      };
+
+      // pending transactions applied with the checks required while generating are taken over as they are
+      const int64_t bob_before = get_balance( bob_id, asset_id_type() );
+      for( int i = 0; i < 10; ++i )
+         push_transfer( skip_sigs );
+      signed_block b = generate_block( ~0 );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 10u );
+      BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ) - bob_before, 10 * 1000 + 45 );
+
+      // pending transactions which skipped checks that are required now are applied again, without signatures
+      // they do not make it into the block
+      for( int i = 0; i < 3; ++i )
+         push_transfer( skip_sigs );
+      b = generate_block( ~0 & ~skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 0u );
+      BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ) - bob_before, 10 * 1000 + 45 );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( pending_rebuild_batches )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.open(dir1.path(), make_genesis, "TEST");
+      db2.open(dir2.path(), make_genesis, "TEST");
+      db2.set_pending_rebuild_batch_size( 2 );
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      // the transactions are unsigned, deferred ones are applied with the skip flags of the node
+      db2.node_properties().skip_flags = skip_sigs;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+
+      int64_t amount = 100;
+      auto make_transfer = [&]() {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         transfer_operation t;
+         t.to = account_id_type(1);
+         t.amount = asset( amount++ );
+         trx.operations.push_back(t);
+         return trx;
+      };
+
+      // one transaction makes it into the block, five are only pending on db2
+      signed_transaction included = make_transfer();
+      PUSH_TX( db1, included, skip_sigs );
+      PUSH_TX( db2, included, skip_sigs );
+      vector<signed_transaction> pending;
+      for( int i = 0; i < 5; ++i )
+      {
+         pending.push_back( make_transfer() );
+         PUSH_TX( db2, pending.back(), skip_sigs );
+      }
+      BOOST_CHECK_EQUAL( db2.get_pending_transaction_stats().pending_count, 6u );
+
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 1u );
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      // the included transaction is dropped by its ID, two are applied and three deferred
+      pending_transaction_stats stats = db2.get_pending_transaction_stats();
+      BOOST_CHECK_EQUAL( stats.last_rebuild_dropped, 1u );
+      BOOST_CHECK_EQUAL( stats.last_rebuild_applied, 2u );
+      BOOST_CHECK_EQUAL( stats.last_rebuild_deferred, 3u );
+      BOOST_CHECK_EQUAL( stats.pending_count, 2u );
+      BOOST_CHECK_EQUAL( stats.deferred_count, 3u );
+      BOOST_CHECK_EQUAL( stats.rebuild_count, 1u );
+
+      // a new transaction applies a batch of deferred ones first
+      PUSH_TX( db2, make_transfer(), skip_sigs );
+      stats = db2.get_pending_transaction_stats();
+      BOOST_CHECK_EQUAL( stats.pending_count, 5u );
+      BOOST_CHECK_EQUAL( stats.deferred_count, 1u );
+
+      // deferred transactions are still candidates for the next block
+      auto b2 = db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b2.transactions.size(), 6u );
+      for( const auto& trx : pending )
+         BOOST_CHECK( db2.is_known_transaction( trx.id() ) );
+      stats = db2.get_pending_transaction_stats();
+      BOOST_CHECK_EQUAL( stats.pending_count, 0u );
+      BOOST_CHECK_EQUAL( stats.deferred_count, 0u );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
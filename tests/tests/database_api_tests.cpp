@@ -603,4 +603,36 @@ BOOST_AUTO_TEST_CASE( get_required_signatures_partially_signed_or_not ) {
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE( snapshot_falls_back_to_chain_database )
+{ try {
+   ACTORS( (alice) );
+   transfer( committee_account, alice_id, asset(500) );
+   generate_block();
+   db.flush();
+
+   auto snapshot = std::make_shared<graphene::app::database_api_snapshot>( data_dir->path() );
+   BOOST_REQUIRE( snapshot->current()->head_block_id.valid() );
+   BOOST_CHECK( *snapshot->current()->head_block_id == db.head_block_id() );
+   graphene::app::database_api db_api( db, snapshot );
+   BOOST_CHECK_EQUAL( db_api.get_account_balances( alice_id, {} ).front().amount.value, 500 );
+
+   // created after the flush
+   ACTORS( (bob) );
+   transfer( committee_account, bob_id, asset(1000) );
+   transfer( committee_account, alice_id, asset(1000) );
+
+   auto accounts = db_api.get_accounts( { alice_id, bob_id } );
+   BOOST_REQUIRE( accounts[0].valid() );
+   BOOST_REQUIRE( accounts[1].valid() );
+   BOOST_CHECK_EQUAL( accounts[1]->name, "bob" );
+   BOOST_CHECK( !db_api.get_objects( { bob_id } )[0].is_null() );
+
+   // the snapshot no longer holds the current state, with pending transactions or after another block
+   BOOST_CHECK_EQUAL( db_api.get_account_balances( alice_id, {} ).front().amount.value, 1500 );
+   BOOST_CHECK_EQUAL( db_api.get_account_balances( bob_id, {} ).front().amount.value, 1000 );
+   generate_block();
+   BOOST_CHECK_EQUAL( db_api.get_account_balances( alice_id, {} ).front().amount.value, 1500 );
+   BOOST_CHECK_EQUAL( db_api.get_objects( { alice_id } )[0]["name"].as_string(), "alice" );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -27,6 +27,7 @@
 #include <graphene/chain/database.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/budget_record_object.hpp>
 
 #include <fc/crypto/digest.hpp>
 
@@ -111,4 +112,235 @@ BOOST_AUTO_TEST_CASE( merge_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( field_diff_undo_test )
+{
+   try {
+      ACTORS( (alice)(bob) );
+      transfer( committee_account, alice_id, asset( 1000 ) );
+      generate_block();
+
+      const auto& by_account = db.get_index_type<account_balance_index>().indices().get<by_account_asset>();
+      const account_balance_id_type balance_id = by_account.find( boost::make_tuple( alice_id, asset_id_type() ) )->id;
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( balance_id(db), []( account_balance_object& b ){ b.balance += 5; } );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_fields.count( balance_id ), 1u );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_values.count( balance_id ), 0u );
+         // a second modification keeps the old value in full, with a field the first one did not change
+         db.modify( balance_id(db), [&]( account_balance_object& b ){ b.owner = bob_id; } );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_fields.count( balance_id ), 0u );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_values.count( balance_id ), 1u );
+         db.modify( balance_id(db), []( account_balance_object& b ){ b.balance += 5; } );
+      }
+      BOOST_CHECK_EQUAL( balance_id(db).balance.value, 1000 );
+      BOOST_CHECK( balance_id(db).owner == alice_id );
+
+      {
+         auto outer = db._undo_db.start_undo_session();
+         db.modify( balance_id(db), []( account_balance_object& b ){ b.balance = 1; } );
+         {
+            auto inner = db._undo_db.start_undo_session();
+            db.remove( balance_id(db) );
+            inner.merge();
+         }
+         BOOST_CHECK( db.find( balance_id ) == nullptr );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_fields.count( balance_id ), 0u );
+      }
+      BOOST_CHECK_EQUAL( balance_id(db).balance.value, 1000 );
+      BOOST_CHECK_EQUAL( db.get_balance( alice_id, asset_id_type() ).amount.value, 1000 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( field_values_nesting_test )
+{
+   try {
+      account_balance_object a;
+      a.balance = 1;
+      account_balance_object b;
+      b.balance = 2;
+
+      std::vector<char> outer_diff;
+      std::vector<char> inner_diff;
+      {
+         const field_values<account_balance_object> outer( a );
+         a.balance = 10;
+         {
+            // captured while the outer values are held, as by a modification within a modification
+            const field_values<account_balance_object> inner( b );
+            b.balance = 20;
+            inner.append_changes( b, inner_diff );
+         }
+         outer.append_changes( a, outer_diff );
+      }
+
+      field_values<account_balance_object>::apply( a, outer_diff.data(), outer_diff.size() );
+      field_values<account_balance_object>::apply( b, inner_diff.data(), inner_diff.size() );
+      BOOST_CHECK_EQUAL( a.balance.value, 1 );
+      BOOST_CHECK_EQUAL( b.balance.value, 2 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( dense_index_test )
+{
+   try {
+      const auto& accounts = db.get_index_type<account_index>().indices();
+      for( const account_object& a : accounts )
+         BOOST_CHECK( db.find( a.get_id() ) == &a );
+
+      const object_id_type next_id = db.get_index<account_object>().get_next_id();
+      {
+         auto ses = db._undo_db.start_undo_session();
+         const auto& dave = db.create<account_object>( []( account_object& a ){ a.name = "dave"; } );
+         BOOST_CHECK( dave.id == next_id );
+         BOOST_CHECK( db.find_object( next_id ) == &dave );
+      }
+      BOOST_CHECK( db.find_object( next_id ) == nullptr );
+      // ids of other types are not found in the table
+      BOOST_CHECK( db.get_index<account_object>().find( asset_id_type() ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( simple_index_tombstones )
+{
+   try {
+      typedef simple_index<budget_record_object> budget_index;
+      const auto& idx = db.get_index_type<budget_index>();
+      const size_t count = idx.size();
+      const fc::uint128 hash = idx.hash();
+
+      {
+         auto ses = db._undo_db.start_undo_session();
+         vector<const budget_record_object*> records;
+         for( size_t i = 0; i < budget_index::slab_size + 2; ++i )
+            records.push_back( &db.create<budget_record_object>( [&]( budget_record_object& r ){ r.record.supply_delta = int64_t(i); } ) );
+         BOOST_CHECK_EQUAL( idx.size(), count + records.size() );
+
+         // empty the first slab and punch a hole in the second one
+         const uint64_t first = records.front()->id.instance();
+         const object_id_type hole = records[records.size() - 2]->id;
+         for( const budget_record_object* r : records )
+            if( r->id.instance() / budget_index::slab_size == first / budget_index::slab_size
+                || r == records[records.size() - 2] )
+               db.remove( *r );
+         const budget_record_object& last = *records.back();
+         BOOST_CHECK( db.find_object( hole ) == nullptr );
+         BOOST_CHECK( db.find_object( last.id ) == &last );
+
+         size_t live = 0;
+         object_id_type prev;
+         for( const budget_record_object& r : idx )
+         {
+            BOOST_CHECK( live == 0 || prev < r.id );
+            BOOST_CHECK( db.find_object( r.id ) == &r );
+            prev = r.id;
+            ++live;
+         }
+         BOOST_CHECK_EQUAL( live, idx.size() );
+
+         // objects do not move when more are created
+         db.create<budget_record_object>( []( budget_record_object& r ){} );
+         BOOST_CHECK( db.find_object( last.id ) == &last );
+         BOOST_CHECK_EQUAL( last.record.supply_delta.value, int64_t(records.size() - 1) );
+      }
+      BOOST_CHECK_EQUAL( idx.size(), count );
+      BOOST_CHECK( idx.hash() == hash );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_digest_test )
+{
+   try {
+      generate_block();
+      const fc::sha256 first_digest = db.state_digest();
+
+      ACTORS( (alice) );
+      // pending transactions are not committed
+      BOOST_CHECK( db.state_digest() == first_digest );
+
+      generate_block();
+      const fc::sha256 second_digest = db.state_digest();
+      BOOST_CHECK( second_digest != first_digest );
+
+      // hashing everything again agrees with the incrementally updated hashes
+      db.clear_pending();
+      db._undo_db.disable();
+      db.modify( db.get_dynamic_global_properties(), []( dynamic_global_property_object& ){} );
+      db._undo_db.enable();
+      BOOST_CHECK( db.state_digest() == second_digest );
+
+      db.pop_block();
+      BOOST_CHECK( db.state_digest() == first_digest );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( field_diff_merge_test )
+{
+   try {
+      ACTORS( (alice)(bob) );
+      transfer( committee_account, alice_id, asset( 1000 ) );
+      generate_block();
+
+      const auto& by_account = db.get_index_type<account_balance_index>().indices().get<by_account_asset>();
+      const account_balance_id_type balance_id = by_account.find( boost::make_tuple( alice_id, asset_id_type() ) )->id;
+
+      // diff + diff, the inner session changes a field the outer one did not
+      {
+         auto outer = db._undo_db.start_undo_session();
+         db.modify( balance_id(db), []( account_balance_object& b ){ b.balance = 1; } );
+         {
+            auto inner = db._undo_db.start_undo_session();
+            db.modify( balance_id(db), [&]( account_balance_object& b ){
+               b.balance = 2;
+               b.owner = bob_id;
+            });
+            inner.merge();
+         }
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_fields.count( balance_id ), 1u );
+      }
+      BOOST_CHECK_EQUAL( balance_id(db).balance.value, 1000 );
+      BOOST_CHECK( balance_id(db).owner == alice_id );
+
+      // diff + whole copy
+      {
+         auto outer = db._undo_db.start_undo_session();
+         db.modify( balance_id(db), []( account_balance_object& b ){ b.balance = 1; } );
+         {
+            auto inner = db._undo_db.start_undo_session();
+            db._undo_db.on_modify( balance_id(db) );
+            db.modify( balance_id(db), [&]( account_balance_object& b ){ b.owner = bob_id; } );
+            inner.merge();
+         }
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_fields.count( balance_id ), 0u );
+         BOOST_CHECK_EQUAL( db._undo_db.head().old_values.count( balance_id ), 1u );
+      }
+      BOOST_CHECK_EQUAL( balance_id(db).balance.value, 1000 );
+      BOOST_CHECK( balance_id(db).owner == alice_id );
+      BOOST_CHECK_EQUAL( db.get_balance( alice_id, asset_id_type() ).amount.value, 1000 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -122,4 +122,272 @@ BOOST_AUTO_TEST_CASE(issue_338)
    BOOST_CHECK_EQUAL( 14733, call.collateral.value );
 } FC_LOG_AND_RETHROW() }
 
+/***
+ * The per-market books of the limit_order_book_index follow the limit_order_index through matching,
+ * cancellation and undo, in the order of the by_price index
+ */
+BOOST_AUTO_TEST_CASE(limit_order_books)
+{ try {
+   ACTORS((alice)(bob));
+
+   const auto& test = create_user_issued_asset("TESTBOOK");
+   const asset_id_type core_id;
+   const asset_id_type test_id = test.id;
+   transfer(committee_account, alice_id, asset(1000000));
+   issue_uia(bob, test.amount(1000000));
+
+   const auto& books = db.get_limit_order_books();
+   const auto& limit_price_idx = db.get_index_type<limit_order_index>().indices().get<by_price>();
+
+   // the orders of a book side, best price first, must be those of the by_price index
+   auto check_side = [&]( asset_id_type sell_asset, asset_id_type receive_asset ) {
+      vector<limit_order_id_type> from_index;
+      for( auto itr = limit_price_idx.lower_bound( price::max( sell_asset, receive_asset ) );
+           itr != limit_price_idx.upper_bound( price::min( sell_asset, receive_asset ) ); ++itr )
+         from_index.push_back( itr->id );
+      vector<limit_order_id_type> from_book;
+      const auto* side = books.find_side( sell_asset, receive_asset );
+      if( side != nullptr )
+         for( const auto& level : *side )
+            for( const limit_order_object* o : level.second )
+               from_book.push_back( o->id );
+      BOOST_CHECK( from_index == from_book );
+   };
+
+   const limit_order_id_type a1 = create_sell_order(alice, asset(100), test.amount(10))->id;
+   const limit_order_id_type a2 = create_sell_order(alice, asset(200), test.amount(20))->id;
+   const limit_order_id_type a3 = create_sell_order(alice, asset(100), test.amount(20))->id;
+   generate_block();
+
+   // a1 and a2 share the best price level, a1 first
+   const auto* side = books.find_side( core_id, test_id );
+   BOOST_REQUIRE( side != nullptr );
+   BOOST_CHECK_EQUAL( side->size(), 2u );
+   BOOST_CHECK_EQUAL( side->begin()->second.size(), 2u );
+   BOOST_CHECK( books.best_order( core_id, test_id )->id == a1 );
+   BOOST_CHECK( books.find_side( test_id, core_id ) == nullptr );
+   check_side( core_id, test_id );
+
+   // fills a1 and part of a2
+   BOOST_CHECK( !create_sell_order(bob, test.amount(15), asset(150)) );
+   BOOST_CHECK( db.find( a1 ) == nullptr );
+   BOOST_CHECK( books.best_order( core_id, test_id )->id == a2 );
+   BOOST_CHECK_EQUAL( books.best_order( core_id, test_id )->for_sale.value, 150 );
+   check_side( core_id, test_id );
+   generate_block();
+
+   // undoing the block puts a1 back in front of a2
+   db.pop_block();
+   BOOST_REQUIRE( db.find( a1 ) != nullptr );
+   BOOST_CHECK( books.best_order( core_id, test_id )->id == a1 );
+   BOOST_CHECK_EQUAL( a2(db).for_sale.value, 200 );
+   check_side( core_id, test_id );
+
+   cancel_limit_order( a3(db) );
+   BOOST_CHECK_EQUAL( books.find_side( core_id, test_id )->size(), 1u );
+   check_side( core_id, test_id );
+
+   // an order on the other side which does not match
+   const limit_order_id_type b1 = create_sell_order(bob, test.amount(10), asset(200))->id;
+   BOOST_CHECK( books.best_order( test_id, core_id )->id == b1 );
+   check_side( test_id, core_id );
+
+   graphene::app::database_api db_api( db );
+   const auto orders = db_api.get_limit_orders( core_id, test_id, 10 );
+   BOOST_REQUIRE_EQUAL( orders.size(), 3u );
+   BOOST_CHECK( orders[0].id == a1 );
+   BOOST_CHECK( orders[1].id == a2 );
+   BOOST_CHECK( orders[2].id == b1 );
+} FC_LOG_AND_RETHROW() }
+
+/***
+ * call_orders_need_check only reports the states in which check_call_orders acts
+ */
+BOOST_AUTO_TEST_CASE(call_orders_need_check)
+{ try {
+   generate_blocks(HARDFORK_436_TIME);
+   generate_block();
+
+   set_expiration( db, trx );
+
+   ACTORS((seller)(borrower)(feedproducer));
+
+   const auto& bitusd = create_bitasset("USDBIT", feedproducer_id);
+   const auto& core   = asset_id_type()(db);
+
+   transfer(committee_account, borrower_id, asset(1000000));
+   update_feed_producers( bitusd, {feedproducer.id} );
+
+   price_feed current_feed;
+   current_feed.maintenance_collateral_ratio = 1750;
+   current_feed.maximum_short_squeeze_ratio = 1100;
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(5);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK( bitusd.bitasset_data(db).current_max_short_squeeze_price == current_feed.max_short_squeeze_price() );
+
+   // no call orders
+   BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+   BOOST_CHECK( !db.call_orders_need_check( core ) );
+
+   // call price is 15/1.75 CORE/USD = 60/7
+   borrow( borrower, bitusd.amount(1000), asset(15000) );
+   transfer(borrower, seller, bitusd.amount(1000));
+   BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(10);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK( bitusd.bitasset_data(db).current_max_short_squeeze_price == current_feed.max_short_squeeze_price() );
+   // no bids
+   BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+
+   // orders placed without apply_order, so the margin call is left to check_call_orders
+   auto place_ask = [&]( int64_t usd, int64_t core_amount ) -> const limit_order_object& {
+      return db.create<limit_order_object>( [&]( limit_order_object& o ) {
+         o.seller = seller_id;
+         o.for_sale = usd;
+         o.sell_price = bitusd.amount( usd ) / core.amount( core_amount );
+         o.expiration = time_point_sec::maximum();
+      });
+   };
+   {
+      auto session = db._undo_db.start_undo_session();
+      // slightly below the call price
+      place_ask( 7, 59 );
+      BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+      BOOST_CHECK( !db.check_call_orders( bitusd ) );
+   }
+   {
+      auto session = db._undo_db.start_undo_session();
+      // below the max short squeeze price
+      place_ask( 7, 78 );
+      BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+      BOOST_CHECK( !db.check_call_orders( bitusd ) );
+   }
+   {
+      auto session = db._undo_db.start_undo_session();
+      // at the call price
+      place_ask( 7, 60 );
+      BOOST_CHECK( db.call_orders_need_check( bitusd ) );
+      BOOST_CHECK( db.check_call_orders( bitusd ) );
+   }
+   BOOST_CHECK( !db.call_orders_need_check( bitusd ) );
+} FC_LOG_AND_RETHROW() }
+
+/***
+ * The call order view of a bitasset follows its call orders and its feed
+ */
+BOOST_AUTO_TEST_CASE(call_order_view)
+{ try {
+   set_expiration( db, trx );
+
+   ACTORS((borrower)(borrower2)(feedproducer));
+
+   const auto& bitusd = create_bitasset("USDBIT", feedproducer_id);
+   const auto& core   = asset_id_type()(db);
+   const auto& bad    = bitusd.bitasset_data(db);
+
+   transfer(committee_account, borrower_id, asset(1000000));
+   transfer(committee_account, borrower2_id, asset(1000000));
+   update_feed_producers( bitusd, {feedproducer.id} );
+
+   price_feed current_feed;
+   current_feed.maintenance_collateral_ratio = 1750;
+   current_feed.maximum_short_squeeze_ratio = 1100;
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(5);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK( !bad.least_collateralized_call.valid() );
+
+   // 300% and 400% collateral
+   const call_order_id_type call1 = borrow( borrower, bitusd.amount(1000), asset(15000) )->id;
+   const call_order_id_type call2 = borrow( borrower2, bitusd.amount(1000), asset(20000) )->id;
+   BOOST_REQUIRE( bad.least_collateralized_call.valid() );
+   BOOST_CHECK( *bad.least_collateralized_call == call1 );
+   BOOST_CHECK( bad.least_collateralization == call1(db).collateralization() );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 0u );
+
+   // 150% and 200% collateral
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(10);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 1u );
+
+   // 125% and 167% collateral
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(12);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 2u );
+   generate_block();
+
+   // call1 goes to 375% collateral, which leaves call2 first in line
+   borrow( borrower, bitusd.amount(0), asset(30000) );
+   BOOST_CHECK( *bad.least_collateralized_call == call2 );
+   BOOST_CHECK( bad.least_collateralized_call_price == call2(db).call_price );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 1u );
+
+   cover( borrower2, bitusd.amount(1000), asset(20000) );
+   BOOST_CHECK( db.find( call2 ) == nullptr );
+   BOOST_CHECK( *bad.least_collateralized_call == call1 );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 0u );
+   generate_block();
+
+   // undoing the block brings back the view with the call orders
+   db.pop_block();
+   BOOST_CHECK( *bad.least_collateralized_call == call2 );
+   BOOST_CHECK_EQUAL( bad.calls_below_maintenance, 2u );
+   verify_asset_supplies( db );
+} FC_LOG_AND_RETHROW() }
+
+/***
+ * Feeds are updated when they expire and the core exchange rate of the asset follows the feed
+ */
+BOOST_AUTO_TEST_CASE(feed_expiration_schedule)
+{ try {
+   set_expiration( db, trx );
+
+   ACTORS((feedproducer));
+
+   const auto& bitusd = create_bitasset("USDBIT", feedproducer_id);
+   const auto& core   = asset_id_type()(db);
+   const auto& bad    = bitusd.bitasset_data(db);
+   BOOST_CHECK( bad.asset_id == bitusd.id );
+
+   update_feed_producers( bitusd, {feedproducer.id} );
+
+   price_feed current_feed;
+   current_feed.settlement_price = bitusd.amount( 1 ) / core.amount(5);
+   publish_feed( bitusd, feedproducer, current_feed );
+   BOOST_CHECK( bad.core_exchange_rate_changed );
+
+   generate_block();
+   BOOST_CHECK( !bad.core_exchange_rate_changed );
+   BOOST_CHECK( bitusd.options.core_exchange_rate == bad.current_feed.core_exchange_rate );
+
+   // an update of the asset is overridden by the feed at the end of the block
+   asset_update_operation op;
+   op.issuer = bitusd.issuer;
+   op.asset_to_update = bitusd.id;
+   op.new_options = bitusd.options;
+   op.new_options.core_exchange_rate = price( core.amount(3), bitusd.amount(1) );
+   trx.operations.push_back( op );
+   PUSH_TX( db, trx, ~0 );
+   trx.operations.clear();
+   BOOST_CHECK( bitusd.options.core_exchange_rate == op.new_options.core_exchange_rate );
+   BOOST_CHECK( bad.core_exchange_rate_changed );
+
+   generate_block();
+   BOOST_CHECK( !bad.core_exchange_rate_changed );
+   BOOST_CHECK( bitusd.options.core_exchange_rate == bad.current_feed.core_exchange_rate );
+
+   // the feed stays until it expires
+   const time_point_sec expiration = bad.feed_expiration_time();
+   generate_blocks( db.head_block_time() + fc::hours(1) );
+   BOOST_CHECK( bad.feed_expiration_time() == expiration );
+   BOOST_CHECK( bad.current_feed.settlement_price == current_feed.settlement_price );
+
+   generate_blocks( expiration + fc::seconds( db.get_global_properties().parameters.block_interval ) );
+   BOOST_CHECK( bad.current_feed.settlement_price.is_null() );
+   BOOST_CHECK( bad.feed_expiration_time() > db.head_block_time() );
+   // a null feed leaves the core exchange rate of the asset alone
+   BOOST_CHECK( bitusd.options.core_exchange_rate == current_feed.settlement_price );
+   verify_asset_supplies( db );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
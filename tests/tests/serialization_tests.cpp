@@ -25,6 +25,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <graphene/chain/database.hpp>
+#include <graphene/db/type_description.hpp>
 
 
 #include <fc/crypto/digest.hpp>
@@ -148,4 +149,33 @@ BOOST_AUTO_TEST_CASE( extension_serialization_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( type_description_test )
+{
+   try {
+      using graphene::db::get_type_description;
+
+      BOOST_CHECK_EQUAL( get_type_description<bool>(), "bool" );
+      BOOST_CHECK_EQUAL( get_type_description<uint64_t>(), "uint64" );
+      BOOST_CHECK_EQUAL( get_type_description<int16_t>(), "int16" );
+      BOOST_CHECK_EQUAL( get_type_description<std::string>(), "string" );
+      BOOST_CHECK_EQUAL( get_type_description<vector<optional<bool>>>(), "vector<optional<bool>>" );
+      BOOST_CHECK_EQUAL( get_type_description<flat_map<string,uint32_t>>(), "flat_map<string,uint32>" );
+
+      // reflected types are described wherever they are nested
+      const std::string asset_description = get_type_description<asset>();
+      BOOST_CHECK_EQUAL( asset_description.substr( 0, 8 ), "{amount:" );
+      BOOST_CHECK( asset_description.find( ";asset_id:{instance:" ) != std::string::npos );
+      BOOST_CHECK_EQUAL( get_type_description<vector<asset>>(), "vector<" + asset_description + ">" );
+      BOOST_CHECK_EQUAL( get_type_description<optional<asset>>(), "optional<" + asset_description + ">" );
+      BOOST_CHECK_EQUAL( get_type_description<std::pair<asset,asset>>(),
+                         "pair<" + asset_description + "," + asset_description + ">" );
+      BOOST_CHECK_EQUAL( get_type_description<flat_set<price>>(),
+                         "flat_set<{base:" + asset_description + ";quote:" + asset_description + ";}>" );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()